@@ -7,424 +7,3974 @@
 #include <algorithm>
 #include <functional>
 #include <sstream>
+#include <array>
+#include <set>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <string_view>
+#include <memory>
+#include <cstring>
+#include <cerrno>
+#include <type_traits>
+#include <mutex>
+#include <cstdint>
+#include <iterator>
+#include <exception>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define EDITING_UTILS_X86_SIMD
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef EDITING_UTILS_PROFILE
+#include <chrono>
+#include <iomanip>
+#endif
 
-class Source {
+#ifdef EDITING_UTILS_PROFILE
+// Counts calls, bytes, matches and time spent in the main functions, enabled by defining EDITING_UTILS_PROFILE
+// before including this. Every thread records into its own counters, so profiling parallel runs doesn't serialise them.
+class Profiler {
+public:
+    enum Point { FromFile, IterateThroughOccurrences, Callback, ParseList, CleanAll, Mismatches, ToFile, PointCount };
+    // Histogram buckets are powers of two of nanoseconds
+    static constexpr int buckets = 40;
+    // Trace events kept per thread, the oldest ones are kept when it's full
+    static constexpr size_t maxEvents = 1 << 20;
+
+    struct Event {
+        Point point;
+        int64_t start;
+        int64_t duration;
+    };
+
+    struct Counters {
+        std::atomic<uint64_t> calls{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> matches{0};
+        std::atomic<uint64_t> nanoseconds{0};
+        std::array<std::atomic<uint64_t>, buckets> histogram{};
+    };
+
+    struct ThreadRecord {
+        int thread = 0;
+        std::array<Counters, PointCount> counters;
+        std::mutex eventsMutex;
+        std::vector<Event> events;
+    };
+
+    static inline const char *pointName(Point point)
+    {
+        static const char *names[] = {"fromFile", "iterateThroughOccurrences", "callback", "parseList", "cleanAll", "mismatches", "toFile"};
+        return names[point];
+    }
+
+    static inline int64_t now()
+    {
+        static const auto epoch = std::chrono::steady_clock::now();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    // The records stay after their threads end, so that they can be dumped after a parallel run
+    static inline ThreadRecord &threadRecord()
+    {
+        thread_local std::shared_ptr<ThreadRecord> record = [] {
+            auto retval = std::make_shared<ThreadRecord>();
+            std::lock_guard<std::mutex> lock(registryMutex());
+            retval->thread = registry().size();
+            registry().push_back(retval);
+            return retval;
+        }();
+        return *record;
+    }
+
+    static inline void record(Point point, int64_t start, uint64_t bytes, uint64_t matches)
+    {
+        int64_t duration = now() - start;
+        ThreadRecord &record = threadRecord();
+        Counters &counters = record.counters[point];
+        counters.calls.fetch_add(1, std::memory_order_relaxed);
+        counters.bytes.fetch_add(bytes, std::memory_order_relaxed);
+        counters.matches.fetch_add(matches, std::memory_order_relaxed);
+        counters.nanoseconds.fetch_add(duration, std::memory_order_relaxed);
+        int bucket = 0;
+        while(bucket < buckets - 1 && (int64_t(1) << (bucket + 1)) <= duration)
+            bucket++;
+        counters.histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(record.eventsMutex);
+        if(record.events.size() < maxEvents)
+            record.events.push_back(Event{point, start, duration});
+    }
+
+    // Prints the counters of all threads added together, latencies are upper bounds of histogram buckets
+    static inline void summary(std::ostream &output = std::cout)
+    {
+        std::lock_guard<std::mutex> lock(registryMutex());
+        std::ios_base::fmtflags flags = output.flags();
+        std::streamsize precision = output.precision();
+        output << std::left << std::setw(28) << "function" << std::right << std::setw(10) << "calls" << std::setw(14) << "MB" << std::setw(12) << "matches"
+               << std::setw(12) << "total ms" << std::setw(12) << "MB/s" << std::setw(12) << "p50 us" << std::setw(12) << "p99 us" << std::endl;
+        output << std::fixed << std::setprecision(1);
+        for(int point = 0; point < PointCount; point++) {
+            uint64_t calls = 0;
+            uint64_t bytes = 0;
+            uint64_t matches = 0;
+            uint64_t nanoseconds = 0;
+            std::array<uint64_t, buckets> histogram{};
+            for(auto &record : registry()) {
+                const Counters &counters = record->counters[point];
+                calls += counters.calls;
+                bytes += counters.bytes;
+                matches += counters.matches;
+                nanoseconds += counters.nanoseconds;
+                for(int i = 0; i < buckets; i++)
+                    histogram[i] += counters.histogram[i];
+            }
+            if(calls == 0) continue;
+            auto percentile = [&] (double part) {
+                uint64_t seen = 0;
+                for(int i = 0; i < buckets; i++) {
+                    seen += histogram[i];
+                    if(seen >= part * calls) return (int64_t(1) << (i + 1)) / 1000.0;
+                }
+                return 0.0;
+            };
+            double megabytes = bytes / 1e6;
+            output << std::left << std::setw(28) << pointName(Point(point)) << std::right << std::setw(10) << calls << std::setw(14) << megabytes
+                   << std::setw(12) << matches << std::setw(12) << nanoseconds / 1e6 << std::setw(12) << (nanoseconds ? megabytes / (nanoseconds / 1e9) : 0)
+                   << std::setw(12) << percentile(0.5) << std::setw(12) << percentile(0.99) << std::endl;
+        }
+        output.flags(flags);
+        output.precision(precision);
+    }
+
+    // Writes the recorded calls in the Chrome trace event format, to be opened in chrome://tracing or Perfetto
+    static inline void writeChromeTrace(const std::string &fileName)
+    {
+        std::ofstream output(fileName);
+        if(!output.good()) throw(std::runtime_error("Trace file could not be created"));
+        output << "{\"traceEvents\":[";
+        bool first = true;
+        std::lock_guard<std::mutex> lock(registryMutex());
+        for(auto &record : registry()) {
+            std::lock_guard<std::mutex> eventsLock(record->eventsMutex);
+            for(const Event &event : record->events) {
+                output << (first ? "\n" : ",\n") << "{\"name\":\"" << pointName(event.point) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << record->thread
+                       << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << event.duration / 1000.0 << "}";
+                first = false;
+            }
+        }
+        output << "\n]}" << std::endl;
+    }
+
+    static inline void reset()
+    {
+        std::lock_guard<std::mutex> lock(registryMutex());
+        for(auto &record : registry()) {
+            for(Counters &counters : record->counters) {
+                counters.calls = 0;
+                counters.bytes = 0;
+                counters.matches = 0;
+                counters.nanoseconds = 0;
+                for(auto &bucket : counters.histogram)
+                    bucket = 0;
+            }
+            std::lock_guard<std::mutex> eventsLock(record->eventsMutex);
+            record->events.clear();
+        }
+    }
+
+private:
+    static inline std::mutex &registryMutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    static inline std::vector<std::shared_ptr<ThreadRecord>> &registry()
+    {
+        static std::vector<std::shared_ptr<ThreadRecord>> records;
+        return records;
+    }
+};
+
+// Records the time from its creation till its destruction
+struct ProfileScope {
+    Profiler::Point point;
+    int64_t start;
+    uint64_t bytes = 0;
+    uint64_t matches = 0;
+
+    inline ProfileScope(Profiler::Point point) : point(point), start(Profiler::now()) {}
+    ProfileScope(const ProfileScope &) = delete;
+    inline ~ProfileScope()
+    {
+        Profiler::record(point, start, bytes, matches);
+    }
+};
+
+#define EDITING_UTILS_PROFILE_SCOPE(point) ProfileScope editingUtilsProfileScope(Profiler::point)
+#define EDITING_UTILS_PROFILE_BYTES(count) (editingUtilsProfileScope.bytes += (count))
+#define EDITING_UTILS_PROFILE_MATCH() (editingUtilsProfileScope.matches++)
+#else
+#define EDITING_UTILS_PROFILE_SCOPE(point)
+#define EDITING_UTILS_PROFILE_BYTES(count)
+#define EDITING_UTILS_PROFILE_MATCH()
+#endif
+
+// Read-only contents of a file, mapped into memory where the platform allows it and read into a buffer otherwise
+class MappedFile {
+    const char *mapped = nullptr;
+    size_t length = 0;
+    std::string fallback;
+public:
+    inline MappedFile(const std::string &fileName)
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        int descriptor = open(fileName.c_str(), O_RDONLY);
+        if(descriptor < 0) throw(std::runtime_error("File could not be opened"));
+        struct stat status;
+        if(fstat(descriptor, &status) < 0) {
+            close(descriptor);
+            throw(std::runtime_error("File could not be opened"));
+        }
+        length = status.st_size;
+        if(length > 0) {
+            void *address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if(address == MAP_FAILED) {
+                close(descriptor);
+                throw(std::runtime_error("File could not be mapped"));
+            }
+            mapped = static_cast<const char*>(address);
+#ifdef POSIX_MADV_SEQUENTIAL
+            posix_madvise(address, length, POSIX_MADV_SEQUENTIAL);
+#endif
+        }
+        close(descriptor);
+#else
+        std::ifstream input(fileName, std::ios::binary);
+        if(!input.good()) throw(std::runtime_error("File could not be opened"));
+        std::stringstream contents;
+        contents << input.rdbuf();
+        fallback = contents.str();
+        mapped = fallback.data();
+        length = fallback.size();
+#endif
+    }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    inline ~MappedFile()
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        if(mapped) munmap(const_cast<char*>(mapped), length);
+#endif
+    }
+    
+    inline const char *data() const { return mapped; }
+    inline size_t size() const { return length; }
+    inline std::string_view view() const { return std::string_view(mapped, length); }
+};
+
+// Whether the file exists and has exactly these contents (possibly followed by a line break, if it's ignored),
+// files of a different size aren't read at all
+inline bool fileContains(const std::string &fileName, std::string_view contents, bool ignoringFinalLineBreak = false)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    struct stat status;
+    if(stat(fileName.c_str(), &status) < 0 || !S_ISREG(status.st_mode)) return false;
+    size_t size = status.st_size;
+    if(size != contents.size() && !(ignoringFinalLineBreak && size == contents.size() + 1)) return false;
+#endif
+    try {
+        MappedFile file(fileName);
+        std::string_view view = file.view();
+        if(ignoringFinalLineBreak && view.size() == contents.size() + 1 && view.back() == '\n') view.remove_suffix(1);
+        return view == contents;
+    }
+    catch(std::runtime_error &) {
+        return false;
+    }
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+// Writes all the contents into an open file, retrying after interruptions and partial writes, returns false on failure
+inline bool writeAll(int descriptor, std::string_view contents)
+{
+    size_t written = 0;
+    while(written < contents.size()) {
+        ssize_t result = write(descriptor, contents.data() + written, contents.size() - written);
+        if(result < 0 && errno == EINTR) continue;
+        if(result < 0) return false;
+        written += result;
+    }
+    return true;
+}
+#endif
+
+// Writes all the contents with a single call where the platform allows it
+inline void writeFile(const std::string &fileName, std::string_view contents)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    int descriptor = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if(descriptor < 0) throw(std::runtime_error("File could not be created"));
+    if(!writeAll(descriptor, contents)) {
+        close(descriptor);
+        throw(std::runtime_error("File could not be written"));
+    }
+    if(close(descriptor) < 0) throw(std::runtime_error("File could not be written"));
+#else
+    std::ofstream output(fileName, std::ios::binary);
+    if(!output.good()) throw(std::runtime_error("File could not be created"));
+    output.write(contents.data(), contents.size());
+    output.close();
+    if(!output.good()) throw(std::runtime_error("File could not be written"));
+#endif
+}
+
+// Leaves the file untouched if it already has the contents, so that its modification time doesn't set off builds.
+// Returns whether it was written.
+inline bool writeFileIfChanged(const std::string &fileName, std::string_view contents, bool ignoringFinalLineBreak = false)
+{
+    if(fileContains(fileName, contents, ignoringFinalLineBreak)) return false;
+    writeFile(fileName, contents);
+    return true;
+}
+
+// Characters that can be a part of an identifier or a number, the one definition of them used everywhere (also while compiling)
+inline constexpr std::array<bool, 256> identifierChars = [] {
+    std::array<bool, 256> retval{};
+    for(int i = 0; i < 256; i++)
+        retval[i] = (i >= 'a' && i <= 'z') || (i >= 'A' && i <= 'Z') || (i >= '0' && i <= '9') || i == '_' || i == '$';
+    return retval;
+}();
+
+constexpr bool isIdentifierChar(char character)
+{
+    return identifierChars[(unsigned char)character];
+}
+
+// Classifies blocks of characters at once, using SIMD instructions where the processor has them,
+// every bit of the masks tells if the character at the corresponding position belongs to the class
+class CharacterScanner {
+public:
+    enum Kernel { Scalar, SSE2, AVX2 };
+    struct Masks {
+        uint32_t identifier = 0;
+        uint32_t whitespace = 0; // Only spaces, tabs and carriage returns
+        uint32_t quote = 0;
+        uint32_t slash = 0;
+        uint32_t apostrophe = 0;
+        uint32_t backslash = 0;
+        uint32_t newline = 0;
+    };
+    static constexpr int blockSize = 32;
+
+    static inline bool supported(Kernel kernel)
+    {
+#if defined(EDITING_UTILS_X86_SIMD)
+        if(kernel == AVX2) return __builtin_cpu_supports("avx2");
+        return true;
+#else
+        return kernel == Scalar;
+#endif
+    }
+
+    // The best supported kernel is chosen on first use, it can be changed to compare them
+    static inline Kernel &kernel()
+    {
+        static Kernel chosen = supported(AVX2) ? AVX2 : supported(SSE2) ? SSE2 : Scalar;
+        return chosen;
+    }
+
+    static inline void setKernel(Kernel wanted)
+    {
+        if(!supported(wanted)) throw(std::runtime_error("The processor does not support this kernel"));
+        kernel() = wanted;
+    }
+
+    // Classifies up to blockSize characters, bits past the size are zero
+    static inline Masks classify(const char *data, int size)
+    {
+        if(size < blockSize) {
+            char padded[blockSize] = {};
+            std::memcpy(padded, data, size);
+            Masks retval = classifyBlock(padded);
+            uint32_t valid = (uint32_t(1) << size) - 1;
+            retval.identifier &= valid;
+            retval.whitespace &= valid;
+            retval.quote &= valid;
+            retval.slash &= valid;
+            retval.apostrophe &= valid;
+            retval.backslash &= valid;
+            retval.newline &= valid;
+            return retval;
+        }
+        return classifyBlock(data);
+    }
+
+    // These return the index of the first character from the given index on that is (or is not) in the classes, or the size if there's none
+    static inline size_t findNonWhitespace(const char *data, size_t size, size_t from = 0)
+    {
+        return find(data, size, from, [] (const Masks &masks) { return ~masks.whitespace; });
+    }
+
+    static inline size_t findQuoteOrSlash(const char *data, size_t size, size_t from = 0)
+    {
+        return find(data, size, from, [] (const Masks &masks) { return masks.quote | masks.slash; });
+    }
+
+    static inline size_t findQuoteSlashOrWhitespace(const char *data, size_t size, size_t from = 0)
+    {
+        return find(data, size, from, [] (const Masks &masks) { return masks.quote | masks.slash | masks.whitespace; });
+    }
+
+    // Characters that can change the state of Lexer in code, in a string literal and in a character literal
+    static inline size_t findQuoteApostropheSlashOrNewline(const char *data, size_t size, size_t from = 0)
+    {
+        return findAnyOf(data, size, from, '"', '\'', '/', '\n');
+    }
+
+    static inline size_t findQuoteBackslashOrNewline(const char *data, size_t size, size_t from = 0)
+    {
+        return findAnyOf(data, size, from, '"', '\\', '\n', '\n');
+    }
+
+    static inline size_t findApostropheBackslashOrNewline(const char *data, size_t size, size_t from = 0)
+    {
+        return findAnyOf(data, size, from, '\'', '\\', '\n', '\n');
+    }
+
+    // Any of four characters (repeated if fewer are needed), only they are compared, which is much cheaper than classifying
+    static inline size_t findAnyOf(const char *data, size_t size, size_t from, char first, char second, char third, char fourth)
+    {
+#if defined(EDITING_UTILS_X86_SIMD)
+        if(kernel() == AVX2) return findAnyOfAVX2(data, size, from, first, second, third, fourth);
+        if(kernel() == SSE2) return findAnyOfSSE2(data, size, from, first, second, third, fourth);
+#endif
+        return findAnyOfScalar(data, size, from, first, second, third, fourth);
+    }
+
+    // Calls the handler with the index of every character picked by the selector in order, until the handler returns false
+    template <typename Selector, typename Handler>
+    static inline void forEach(const char *data, size_t size, Selector selector, Handler handler)
+    {
+        if(kernel() == Scalar) {
+            for(size_t i = 0; i < size; i++)
+                if((selector(classifyScalar(data + i, 1)) & 1) && !handler(int(i))) return;
+            return;
+        }
+        for(size_t from = 0; from < size; from += blockSize) {
+            int length = std::min<size_t>(blockSize, size - from);
+            uint32_t found = selector(classify(data + from, length));
+            if(length < blockSize) found &= (uint32_t(1) << length) - 1;
+            while(found) {
+                if(!handler(int(from + lowestBit(found)))) return;
+                found &= found - 1;
+            }
+        }
+    }
+
+    // Like forEach, but for every one of four characters (repeated if fewer are needed), which is cheaper than classifying
+    template <typename Handler>
+    static inline void forEachOf(const char *data, size_t size, char first, char second, char third, char fourth, Handler handler)
+    {
+        Kernel chosen = kernel();
+        if(chosen == Scalar) {
+            for(size_t i = 0; i < size; i++)
+                if((data[i] == first || data[i] == second || data[i] == third || data[i] == fourth) && !handler(int(i))) return;
+            return;
+        }
+        int length = 0;
+        for(size_t from = 0; from < size; from += length) {
+            uint32_t found = matchAnyOf(chosen, data, size, from, first, second, third, fourth, length);
+            while(found) {
+                if(!handler(int(from + lowestBit(found)))) return;
+                found &= found - 1;
+            }
+        }
+    }
+
+private:
+    template <typename Selector>
+    static inline size_t find(const char *data, size_t size, size_t from, Selector selector)
+    {
+        // Most runs are short (indentation, a few spaces) and classifying whole blocks only pays off for long ones
+        size_t probed = (kernel() == Scalar) ? size : std::min(size, from + 16);
+        for(; from < probed; from++)
+            if(selector(classifyScalar(data + from, 1)) & 1) return from;
+        while(from < size) {
+            int length = std::min<size_t>(blockSize, size - from);
+            uint32_t found = selector(classify(data + from, length));
+            if(length < blockSize) found &= (uint32_t(1) << length) - 1;
+            if(found) return from + lowestBit(found);
+            from += length;
+        }
+        return size;
+    }
+
+    // Matches the characters from the given index on, as many as there are up to blockSize, and sets the length matched.
+    // With SIMD instructions the last block overlaps the one before it instead of being copied.
+    static inline uint32_t matchAnyOf(Kernel chosen, const char *data, size_t size, size_t from, char first, char second, char third, char fourth, int &length)
+    {
+        size_t left = size - from;
+#if defined(EDITING_UTILS_X86_SIMD)
+        if(chosen == AVX2 && left >= blockSize) {
+            length = blockSize;
+            return matchAVX2(data + from, first, second, third, fourth);
+        }
+        if(chosen != Scalar && size >= 16) {
+            length = std::min<size_t>(left, 16);
+            if(left >= 16) return matchSSE2(data + from, first, second, third, fourth);
+            return matchSSE2(data + size - 16, first, second, third, fourth) >> (16 - left);
+        }
+#endif
+        length = std::min<size_t>(left, blockSize);
+        uint32_t retval = 0;
+        for(int i = 0; i < length; i++) {
+            char current = data[from + i];
+            retval |= uint32_t(current == first || current == second || current == third || current == fourth) << i;
+        }
+        return retval;
+    }
+
+    // Eight characters at a time in a 64-bit integer, a byte is zero after XOR with a character it equals
+    static inline size_t findAnyOfScalar(const char *data, size_t size, size_t from, char first, char second, char third, char fourth)
+    {
+        constexpr uint64_t ones = 0x0101010101010101ull;
+        constexpr uint64_t highs = 0x8080808080808080ull;
+        auto hasZero = [] (uint64_t word) { return (word - ones) & ~word & highs; };
+        for(; from + 8 <= size; from += 8) {
+            uint64_t word;
+            std::memcpy(&word, data + from, 8);
+            if(hasZero(word ^ (ones * (unsigned char)first)) | hasZero(word ^ (ones * (unsigned char)second))
+                    | hasZero(word ^ (ones * (unsigned char)third)) | hasZero(word ^ (ones * (unsigned char)fourth)))
+                break;
+        }
+        for(; from < size; from++)
+            if(data[from] == first || data[from] == second || data[from] == third || data[from] == fourth) return from;
+        return size;
+    }
+
+    static inline int lowestBit(uint32_t mask)
+    {
+#if defined(__GNUC__)
+        return __builtin_ctz(mask);
+#else
+        int retval = 0;
+        while(!(mask & 1)) {
+            mask >>= 1;
+            retval++;
+        }
+        return retval;
+#endif
+    }
+
+    static inline Masks classifyBlock(const char *data)
+    {
+#if defined(EDITING_UTILS_X86_SIMD)
+        if(kernel() == AVX2) return classifyAVX2(data);
+        if(kernel() == SSE2) return classifySSE2(data);
+#endif
+        return classifyScalar(data, blockSize);
+    }
+
+    static inline Masks classifyScalar(const char *data, int size)
+    {
+        // One bit per class in the same order as in Masks
+        static const std::array<unsigned char, 256> table = [] {
+            std::array<unsigned char, 256> retval{};
+            for(int i = 0; i < 256; i++) {
+                if(isIdentifierChar(char(i))) retval[i] = 1;
+                else if(i == ' ' || i == '\t' || i == '\r') retval[i] = 2;
+                else if(i == '"') retval[i] = 4;
+                else if(i == '/') retval[i] = 8;
+                else if(i == '\'') retval[i] = 16;
+                else if(i == '\\') retval[i] = 32;
+                else if(i == '\n') retval[i] = 64;
+            }
+            return retval;
+        }();
+        Masks retval;
+        for(int i = 0; i < size; i++) {
+            uint32_t classes = table[(unsigned char)data[i]];
+            retval.identifier |= (classes & 1) << i;
+            retval.whitespace |= ((classes >> 1) & 1) << i;
+            retval.quote |= ((classes >> 2) & 1) << i;
+            retval.slash |= ((classes >> 3) & 1) << i;
+            retval.apostrophe |= ((classes >> 4) & 1) << i;
+            retval.backslash |= ((classes >> 5) & 1) << i;
+            retval.newline |= ((classes >> 6) & 1) << i;
+        }
+        return retval;
+    }
+
+#if defined(EDITING_UTILS_X86_SIMD)
+    // All the ranges are in the lower half of ASCII, so signed comparisons are fine and reject any bytes above 127
+    static inline uint32_t classifySSE2Identifier(__m128i block)
+    {
+        __m128i lower = _mm_or_si128(block, _mm_set1_epi8(0x20));
+        __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), lower));
+        __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8('0' - 1)), _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), block));
+        __m128i other = _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('_')), _mm_cmpeq_epi8(block, _mm_set1_epi8('$')));
+        return _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(letter, digit), other));
+    }
+
+    static inline Masks classifySSE2(const char *data)
+    {
+        Masks retval;
+        for(int half = 0; half < 2; half++) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + half * 16));
+            __m128i whitespace = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\t'))),
+                                              _mm_cmpeq_epi8(block, _mm_set1_epi8('\r')));
+            int shift = half * 16;
+            retval.identifier |= classifySSE2Identifier(block) << shift;
+            retval.whitespace |= uint32_t(_mm_movemask_epi8(whitespace)) << shift;
+            retval.quote |= uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8('"')))) << shift;
+            retval.slash |= uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8('/')))) << shift;
+            retval.apostrophe |= uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8('\'')))) << shift;
+            retval.backslash |= uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8('\\')))) << shift;
+            retval.newline |= uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8('\n')))) << shift;
+        }
+        return retval;
+    }
+
+    __attribute__((target("avx2"))) static inline Masks classifyAVX2(const char *data)
+    {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+        __m256i lower = _mm256_or_si256(block, _mm256_set1_epi8(0x20));
+        __m256i letter = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+        __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(block, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), block));
+        __m256i other = _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('_')), _mm256_cmpeq_epi8(block, _mm256_set1_epi8('$')));
+        __m256i whitespace = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\t'))),
+                                             _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\r')));
+        Masks retval;
+        retval.identifier = _mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(letter, digit), other));
+        retval.whitespace = _mm256_movemask_epi8(whitespace);
+        retval.quote = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('"')));
+        retval.slash = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('/')));
+        retval.apostrophe = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\'')));
+        retval.backslash = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\\')));
+        retval.newline = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n')));
+        return retval;
+    }
+
+    static inline uint32_t matchSSE2(const char *data, char first, char second, char third, char fourth)
+    {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+        return _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(first)), _mm_cmpeq_epi8(block, _mm_set1_epi8(second))),
+                                              _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(third)), _mm_cmpeq_epi8(block, _mm_set1_epi8(fourth)))));
+    }
+
+    // The last block overlaps the one before it instead of being copied, only texts shorter than 16 characters are searched one at a time
+    static inline size_t findAnyOfSSE2(const char *data, size_t size, size_t from, char first, char second, char third, char fourth)
+    {
+        if(size < 16) return findAnyOfScalar(data, size, from, first, second, third, fourth);
+        for(; from + 16 <= size; from += 16)
+            if(uint32_t found = matchSSE2(data + from, first, second, third, fourth)) return from + lowestBit(found);
+        if(from >= size) return size;
+        uint32_t found = matchSSE2(data + size - 16, first, second, third, fourth) >> (from - (size - 16));
+        return found ? from + lowestBit(found) : size;
+    }
+
+    __attribute__((target("avx2"))) static inline uint32_t matchAVX2(const char *data, char first, char second, char third, char fourth)
+    {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+        return _mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(first)), _mm256_cmpeq_epi8(block, _mm256_set1_epi8(second))),
+                                                    _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(third)), _mm256_cmpeq_epi8(block, _mm256_set1_epi8(fourth)))));
+    }
+
+    __attribute__((target("avx2"))) static inline size_t findAnyOfAVX2(const char *data, size_t size, size_t from, char first, char second, char third, char fourth)
+    {
+        if(size < blockSize) return findAnyOfSSE2(data, size, from, first, second, third, fourth);
+        for(; from + blockSize <= size; from += blockSize)
+            if(uint32_t found = matchAVX2(data + from, first, second, third, fourth)) return from + lowestBit(found);
+        if(from >= size) return size;
+        uint32_t found = matchAVX2(data + size - blockSize, first, second, third, fourth) >> (from - (size - blockSize));
+        return found ? from + lowestBit(found) : size;
+    }
+#endif
+};
+
+// The lexical state machine shared by all the scanners, so that they agree on what is code, a literal or a comment.
+// String and character literals end at the next unescaped quote (or at an unescaped line break), raw strings
+// like R"x(...)x" end only at their delimiter, ' after a number is a digit separator and comments are // and /* */.
+// The transitions are in a table indexed by the mode and the class of the character; characters that can't change
+// the mode are skipped in blocks using CharacterScanner. Text can be given in pieces of any size, the State carries
+// everything needed to continue from where the previous piece ended.
+class Lexer {
+public:
+    // What a character is a part of, the quotes starting and ending literals (including delimiters of raw strings) are separate.
+    // The closing delimiter of a raw string split between two texts is reported as a part of the string, only its quote as the end.
+    enum Kind : uint8_t { Code, Comment, StringStart, String, StringEnd, CharacterStart, Character, CharacterEnd };
+    
+    enum Mode : uint8_t { InCode, AfterSlash, InString, InStringEscape, InCharacter, InCharacterEscape,
+                          InLineComment, InBlockComment, AfterStar, InRawDelimiter, InRawString, ModeCount };
+    
+    struct State {
+        Mode mode = InCode;
+        // The word (identifier or number) the previous text ended with, its length (4 means longer), first and last characters
+        uint8_t wordLength = 0;
+        char word[3] = {};
+        char wordEnd = '\0';
+        // The delimiter of the raw string and how many characters of its end were found at the end of the previous text
+        uint8_t delimiterLength = 0;
+        uint8_t matched = 0;
+        char delimiter[16] = {};
+        
+        inline bool operator==(const State &other) const
+        {
+            return mode == other.mode && wordLength == other.wordLength && std::equal(word, word + std::min<int>(wordLength, 3), other.word)
+                    && (wordLength == 0 || wordEnd == other.wordEnd)
+                    && delimiterLength == other.delimiterLength && matched == other.matched
+                    && std::equal(delimiter, delimiter + delimiterLength, other.delimiter);
+        }
+        
+        inline bool operator!=(const State &other) const
+        {
+            return !(*this == other);
+        }
+        
+        inline bool inLiteral() const
+        {
+            return mode == InString || mode == InStringEscape || mode == InCharacter || mode == InCharacterEscape
+                    || mode == InRawDelimiter || mode == InRawString;
+        }
+    };
+    
+    static constexpr bool isLiteral(Kind kind)
+    {
+        return kind >= StringStart;
+    }
+    
+    // Calls the function with every run of characters of the same kind as (start, end, kind), until it returns false.
+    // A slash at the end of the text may start a comment, so it's reported by the next call (as starting at -1) or by scanLine.
+    // Returns false if it was stopped.
+    template <typename Emit>
+    static inline bool scan(const char *data, int size, State &state, Emit emit)
+    {
+        const Table &steps = table();
+        if(state.mode != InCode) state.wordLength = 0;
+        int runStart = (state.mode == AfterSlash) ? -1 : 0;
+        Kind runKind = steps.plain[state.mode];
+        // Where the code the current character is in started, words are looked for only in it
+        int codeStart = 0;
+        // The last digit separator and where its number started
+        int separator = -1;
+        int separatorWordStart = 0;
+        auto put = [&] (int position, Kind kind) {
+            if(kind == runKind) return true;
+            if(position > runStart && !emit(runStart, position, runKind)) return false;
+            runStart = position;
+            runKind = kind;
+            return true;
+        };
+        int i = 0;
+        while(i < size) {
+            int next = skip(data, size, i, state);
+            if(next > i) {
+                if(!put(i, steps.plain[state.mode])) return false;
+                i = next;
+                if(i >= size) break;
+            }
+            char current = data[i];
+            CharacterClass type = steps.classes[(unsigned char)current];
+            if(state.mode == AfterSlash) {
+                // The slash before is a comment only with another slash or a star after it
+                if(!put(i - 1, (type == Slash || type == Star) ? Comment : Code)) return false;
+                if(type == Slash || type == Star) {
+                    state.mode = (type == Slash) ? InLineComment : InBlockComment;
+                    i++;
+                }
+                else state.mode = InCode;
+                continue;
+            }
+            if(state.mode == InRawDelimiter) {
+                if(current == '(') state.mode = InRawString;
+                else if(type != Other || current == ' ' || current == ')' || current == '\t' || state.delimiterLength == sizeof(state.delimiter)) {
+                    // Not a valid raw string, lexed as an ordinary one
+                    state.mode = InString;
+                    continue;
+                }
+                else state.delimiter[state.delimiterLength++] = current;
+                if(!put(i, StringStart)) return false;
+                i++;
+                continue;
+            }
+            if(state.mode == InRawString) {
+                int length = state.delimiterLength;
+                if(state.matched == 0) {
+                    // current is ')', usually the whole end is in this text and is reported as the end of the literal
+                    if(i + length + 1 < size) {
+                        if(data[i + length + 1] == '"' && std::equal(state.delimiter, state.delimiter + length, data + i + 1)) {
+                            if(!put(i, StringEnd)) return false;
+                            i += length + 2;
+                            state.mode = InCode;
+                            codeStart = i;
+                            continue;
+                        }
+                        if(!put(i, String)) return false;
+                        i++;
+                        continue;
+                    }
+                    state.matched = 1;
+                }
+                else if(state.matched <= length && current == state.delimiter[state.matched - 1]) state.matched++;
+                else if(state.matched == length + 1 && current == '"') {
+                    if(!put(i, StringEnd)) return false;
+                    state.matched = 0;
+                    state.mode = InCode;
+                    i++;
+                    codeStart = i;
+                    continue;
+                }
+                else {
+                    state.matched = 0;
+                    continue;
+                }
+                if(!put(i, String)) return false;
+                i++;
+                continue;
+            }
+            if(state.mode == InCode && (type == Quote || type == Apostrophe)) {
+                int length;
+                char word[3];
+                int wordStart = wordBefore(data, i, codeStart, state, word, length, separator, separatorWordStart);
+                if(type == Quote && isRawPrefix(word, length)) {
+                    if(!put(i, StringStart)) return false;
+                    state.mode = InRawDelimiter;
+                    state.delimiterLength = 0;
+                    state.matched = 0;
+                    i++;
+                    continue;
+                }
+                if(type == Apostrophe && length > 0 && word[0] >= '0' && word[0] <= '9') {
+                    separator = i;
+                    separatorWordStart = wordStart;
+                    if(!put(i, Code)) return false;
+                    i++;
+                    continue;
+                }
+            }
+            Step step = steps.steps[state.mode][type];
+            if(step.next != AfterSlash && !put(i, step.kind)) return false;
+            if(step.next == InCode && state.mode != InCode) codeStart = i + 1;
+            state.mode = step.next;
+            i++;
+        }
+        int end = (state.mode == AfterSlash) ? size - 1 : size;
+        if(end > runStart && !emit(runStart, end, runKind)) return false;
+        int length = 0;
+        char word[3] = {};
+        if(state.mode == InCode) wordBefore(data, size, codeStart, state, word, length, separator, separatorWordStart);
+        if(length > 0 && size > 0 && (isIdentifierChar(data[size - 1]) || data[size - 1] == '\'')) state.wordEnd = data[size - 1];
+        state.wordLength = length;
+        std::copy(word, word + 3, state.word);
+        return true;
+    }
+    
+    // Scans a line, the end of the line is handled too
+    template <typename Emit>
+    static inline bool scanLine(const char *data, int size, State &state, Emit emit)
+    {
+        if(!scan(data, size, state, emit)) return false;
+        if(state.mode == AfterSlash && !emit(size - 1, size, Code)) return false;
+        endLine(state);
+        return true;
+    }
+    
+    template <typename Line, typename Emit>
+    static inline bool scanLine(const Line &line, State &state, Emit emit)
+    {
+        return scanLine(line.data(), line.size(), state, emit);
+    }
+    
+    // The state after a line break, a slash before it must have been reported already
+    static inline void endLine(State &state)
+    {
+        state.mode = (state.mode == AfterSlash) ? InCode : table().steps[state.mode][Newline].next;
+        state.wordLength = 0;
+        state.matched = 0;
+    }
+    
+private:
+    enum CharacterClass : uint8_t { Other, Quote, Apostrophe, Backslash, Slash, Star, Newline, ClassCount };
+    
+    struct Step {
+        Mode next;
+        Kind kind; // Of the character causing the step
+    };
+    
+    struct Table {
+        std::array<CharacterClass, 256> classes;
+        std::array<Kind, ModeCount> plain; // Kinds of characters that don't change the mode
+        std::array<std::array<Step, ClassCount>, ModeCount> steps;
+    };
+    
+    // Quotes in code, the slash before a comment and raw strings need more than the table and are handled separately
+    static inline const Table &table()
+    {
+        static const Table built = [] {
+            Table retval;
+            retval.classes.fill(Other);
+            retval.classes['"'] = Quote;
+            retval.classes['\''] = Apostrophe;
+            retval.classes['\\'] = Backslash;
+            retval.classes['/'] = Slash;
+            retval.classes['*'] = Star;
+            retval.classes['\n'] = Newline;
+            retval.plain = {Code, Code, String, String, Character, Character, Comment, Comment, Comment, StringStart, String};
+            for(int mode = 0; mode < ModeCount; mode++)
+                retval.steps[mode].fill(Step{Mode(mode), retval.plain[mode]});
+            auto set = [&] (Mode mode, CharacterClass type, Mode next, Kind kind) {
+                retval.steps[mode][type] = Step{next, kind};
+            };
+            set(InCode, Quote, InString, StringStart);
+            set(InCode, Apostrophe, InCharacter, CharacterStart);
+            set(InCode, Slash, AfterSlash, Code);
+            set(InString, Quote, InCode, StringEnd);
+            set(InString, Backslash, InStringEscape, String);
+            set(InString, Newline, InCode, Code);
+            retval.steps[InStringEscape].fill(Step{InString, String});
+            set(InCharacter, Apostrophe, InCode, CharacterEnd);
+            set(InCharacter, Backslash, InCharacterEscape, Character);
+            set(InCharacter, Newline, InCode, Code);
+            retval.steps[InCharacterEscape].fill(Step{InCharacter, Character});
+            set(InLineComment, Newline, InCode, Code);
+            set(InBlockComment, Star, AfterStar, Comment);
+            retval.steps[AfterStar].fill(Step{InBlockComment, Comment});
+            set(AfterStar, Star, AfterStar, Comment);
+            set(AfterStar, Slash, InCode, Comment);
+            set(InRawDelimiter, Newline, InCode, Code);
+            return retval;
+        }();
+        return built;
+    }
+    
+    // The first character from the given one on that can change the mode
+    static inline int skip(const char *data, int size, int from, const State &state)
+    {
+        if(state.mode == InRawString && state.matched > 0) return from;
+        const void *found = nullptr;
+        switch(state.mode) {
+        case InCode:
+            return CharacterScanner::findQuoteApostropheSlashOrNewline(data, size, from);
+        case InString:
+            return CharacterScanner::findQuoteBackslashOrNewline(data, size, from);
+        case InCharacter:
+            return CharacterScanner::findApostropheBackslashOrNewline(data, size, from);
+        case InLineComment:
+            found = std::memchr(data + from, '\n', size - from);
+            break;
+        case InBlockComment:
+            found = std::memchr(data + from, '*', size - from);
+            break;
+        case InRawString:
+            found = std::memchr(data + from, ')', size - from);
+            break;
+        default:
+            return from;
+        }
+        return found ? static_cast<const char*>(found) - data : size;
+    }
+    
+    // The word (identifier characters and digit separators) right before the position in the code starting at the given index,
+    // continuing the one the previous text ended with if the code started before the text. Returns where it starts.
+    // The word of the last digit separator found is given so that long numbers aren't walked through again at every separator.
+    static inline int wordBefore(const char *data, int position, int codeStart, const State &state, char (&word)[3], int &length,
+                                 int separator = -1, int separatorWordStart = 0)
+    {
+        int start = position;
+        while(start > codeStart) {
+            char before = data[start - 1];
+            bool afterIdentifier = (start > codeStart + 1) ? isIdentifierChar(data[start - 2])
+                    : (codeStart == 0 && state.wordLength > 0 && isIdentifierChar(state.wordEnd));
+            if(!isIdentifierChar(before) && !(before == '\'' && afterIdentifier)) break;
+            if(start - 1 == separator) {
+                start = separatorWordStart;
+                break;
+            }
+            start--;
+        }
+        length = 0;
+        if(start == 0) {
+            length = state.wordLength;
+            std::copy(state.word, state.word + std::min(length, 3), word);
+        }
+        for(int i = start; i < position && length < 4; i++, length++)
+            if(length < 3) word[length] = data[i];
+        return start;
+    }
+    
+    static inline bool isRawPrefix(const char (&word)[3], int length)
+    {
+        if(length == 0 || length > 3 || word[length - 1] != 'R') return false;
+        if(length == 1) return true;
+        if(length == 2) return word[0] == 'L' || word[0] == 'u' || word[0] == 'U';
+        return word[0] == 'u' && word[1] == '8';
+    }
+};
+
+#if __cplusplus >= 202002L
+// An expression for iterateThroughOccurrences given as a template argument, as in iterateThroughOccurrences<"unique_ptr<int>">(callback)
+template <size_t Size>
+struct FixedPattern {
+    char text[Size] = {};
+    static constexpr int size = Size - 1;
+    
+    constexpr FixedPattern(const char (&given)[Size])
+    {
+        for(size_t i = 0; i < Size; i++)
+            text[i] = given[i];
+    }
+    
+    // Whether an occurrence can continue on the next line after each number of matched characters
+    constexpr std::array<bool, Size> lineBreaks() const
+    {
+        std::array<bool, Size> retval{};
+        for(size_t i = 0; i < Size; i++)
+            retval[i] = !isIdentifierChar(text[i]);
+        return retval;
+    }
+};
+#endif
+
+// Many expressions searched for in a single pass (an Aho-Corasick automaton), meant for iterateThroughOccurrences
+// The expressions follow the same rules as a single expression given to iterateThroughOccurrences, there must be at least one
+class PatternSet {
+    std::array<int, 256> classes;
+    int classCount = 1;
+    std::vector<int> transitions;
+    std::vector<std::vector<int>> outputs;
+    int longestPattern = 0;
+public:
+    std::vector<std::string> patterns;
+
+    inline PatternSet(const std::vector<std::string> &patterns) : patterns(patterns)
+    {
+        if(patterns.empty()) throw(std::runtime_error("No patterns"));
+        // Characters not present in any pattern share the class zero, which keeps the table small
+        classes.fill(0);
+        for(auto &pattern : patterns) {
+            if(pattern.empty()) throw(std::runtime_error("Empty pattern"));
+            longestPattern = std::max<int>(longestPattern, pattern.size());
+            for(char character : pattern)
+                if(classes[(unsigned char)character] == 0)
+                    classes[(unsigned char)character] = classCount++;
+        }
+
+        // Build the trie, -1 is a missing edge
+        transitions.assign(classCount, -1);
+        outputs.emplace_back();
+        for(int i = 0; i < (int)patterns.size(); i++) {
+            int state = 0;
+            for(char character : patterns[i]) {
+                int &next = transitions[state * classCount + classes[(unsigned char)character]];
+                if(next < 0) {
+                    next = outputs.size();
+                    outputs.emplace_back();
+                    transitions.resize(transitions.size() + classCount, -1);
+                }
+                state = transitions[state * classCount + classes[(unsigned char)character]];
+            }
+            outputs[state].push_back(i);
+        }
+
+        // Turn it into a complete automaton by breadth-first search over failure links
+        std::vector<int> failure(outputs.size(), 0);
+        std::vector<int> queue;
+        for(int c = 0; c < classCount; c++) {
+            int &next = transitions[c];
+            if(next < 0) next = 0;
+            else queue.push_back(next);
+        }
+        for(int i = 0; i < (int)queue.size(); i++) {
+            int state = queue[i];
+            outputs[state].insert(outputs[state].end(), outputs[failure[state]].begin(), outputs[failure[state]].end());
+            for(int c = 0; c < classCount; c++) {
+                int &next = transitions[state * classCount + c];
+                if(next < 0) next = transitions[failure[state] * classCount + c];
+                else {
+                    failure[next] = transitions[failure[state] * classCount + c];
+                    queue.push_back(next);
+                }
+            }
+        }
+        for(auto &matched : outputs)
+            std::sort(matched.begin(), matched.end());
+    }
+
+    inline int next(int state, char character) const
+    {
+        return transitions[state * classCount + classes[(unsigned char)character]];
+    }
+
+    // Indexes of patterns that end when the automaton reaches the state
+    inline const std::vector<int> &matched(int state) const
+    {
+        return outputs[state];
+    }
+
+    inline int longest() const
+    {
+        return longestPattern;
+    }
+};
+
+// A difference between two sequences, elements from firstStart to firstEnd (excluding) of the first one
+// were replaced by elements from secondStart to secondEnd (excluding) of the second one
+struct DiffHunk {
+    int firstStart = 0;
+    int firstEnd = 0;
+    int secondStart = 0;
+    int secondEnd = 0;
+};
+
+// Myers' O(ND) difference algorithm in its linear space version, so it's fast if the sequences are mostly the same.
+// The sequences can be anything indexable with elements comparable by ==.
+class Diff {
+    template <typename First, typename Second>
+    struct Comparison {
+        const First &first;
+        const Second &second;
+        std::vector<DiffHunk> &hunks;
+        std::vector<int> forward;
+        std::vector<int> backward;
+        
+        inline void addHunk(int firstStart, int firstEnd, int secondStart, int secondEnd)
+        {
+            if(!hunks.empty() && hunks.back().firstEnd == firstStart && hunks.back().secondEnd == secondStart) {
+                hunks.back().firstEnd = firstEnd;
+                hunks.back().secondEnd = secondEnd;
+            }
+            else hunks.push_back(DiffHunk{firstStart, firstEnd, secondStart, secondEnd});
+        }
+        
+        inline void compare(int firstStart, int firstEnd, int secondStart, int secondEnd)
+        {
+            while(firstStart < firstEnd && secondStart < secondEnd && first[firstStart] == second[secondStart]) {
+                firstStart++;
+                secondStart++;
+            }
+            while(firstStart < firstEnd && secondStart < secondEnd && first[firstEnd - 1] == second[secondEnd - 1]) {
+                firstEnd--;
+                secondEnd--;
+            }
+            if(firstStart == firstEnd || secondStart == secondEnd) {
+                if(firstStart < firstEnd || secondStart < secondEnd) addHunk(firstStart, firstEnd, secondStart, secondEnd);
+                return;
+            }
+            
+            // Looks for the middle snake, going from both ends at once
+            int firstSize = firstEnd - firstStart;
+            int secondSize = secondEnd - secondStart;
+            int delta = firstSize - secondSize;
+            bool odd = delta & 1;
+            int maximum = (firstSize + secondSize + 1) / 2;
+            int offset = maximum + 1;
+            forward.assign(2 * offset + 1, 0);
+            backward.assign(2 * offset + 1, 0);
+            for(int d = 0; d <= maximum; d++) {
+                for(int k = -d; k <= d; k += 2) {
+                    int x = (k == -d || (k != d && forward[offset + k - 1] < forward[offset + k + 1])) ? forward[offset + k + 1] : forward[offset + k - 1] + 1;
+                    int y = x - k;
+                    int snakeX = x;
+                    int snakeY = y;
+                    while(x < firstSize && y < secondSize && first[firstStart + x] == second[secondStart + y]) {
+                        x++;
+                        y++;
+                    }
+                    forward[offset + k] = x;
+                    if(odd && delta - k >= -(d - 1) && delta - k <= d - 1 && x + backward[offset + delta - k] >= firstSize) {
+                        split(firstStart, firstEnd, secondStart, secondEnd, firstStart + snakeX, secondStart + snakeY, firstStart + x, secondStart + y);
+                        return;
+                    }
+                }
+                for(int k = -d; k <= d; k += 2) {
+                    int x = (k == -d || (k != d && backward[offset + k - 1] < backward[offset + k + 1])) ? backward[offset + k + 1] : backward[offset + k - 1] + 1;
+                    int y = x - k;
+                    int snakeX = x;
+                    int snakeY = y;
+                    while(x < firstSize && y < secondSize && first[firstEnd - 1 - x] == second[secondEnd - 1 - y]) {
+                        x++;
+                        y++;
+                    }
+                    backward[offset + k] = x;
+                    if(!odd && delta - k >= -d && delta - k <= d && x + forward[offset + delta - k] >= firstSize) {
+                        split(firstStart, firstEnd, secondStart, secondEnd, firstEnd - x, secondEnd - y, firstEnd - snakeX, secondEnd - snakeY);
+                        return;
+                    }
+                }
+            }
+            addHunk(firstStart, firstEnd, secondStart, secondEnd);
+        }
+        
+        inline void split(int firstStart, int firstEnd, int secondStart, int secondEnd, int snakeFirstStart, int snakeSecondStart, int snakeFirstEnd, int snakeSecondEnd)
+        {
+            if(snakeFirstStart == firstStart && snakeSecondStart == secondStart && snakeFirstEnd == firstEnd && snakeSecondEnd == secondEnd) {
+                addHunk(firstStart, firstEnd, secondStart, secondEnd);
+                return;
+            }
+            compare(firstStart, snakeFirstStart, secondStart, snakeSecondStart);
+            compare(snakeFirstEnd, firstEnd, snakeSecondEnd, secondEnd);
+        }
+    };
+    
+public:
+    // Differences between parts of the sequences, the hunks are added to the vector
+    template <typename First, typename Second>
+    static inline void compare(const First &first, int firstStart, int firstEnd, const Second &second, int secondStart, int secondEnd, std::vector<DiffHunk> &hunks)
+    {
+        Comparison<First, Second> comparison{first, second, hunks, {}, {}};
+        comparison.compare(firstStart, firstEnd, secondStart, secondEnd);
+    }
+    
+    template <typename First, typename Second>
+    static inline std::vector<DiffHunk> compare(const First &first, const Second &second)
+    {
+        std::vector<DiffHunk> retval;
+        compare(first, 0, first.size(), second, 0, second.size(), retval);
+        return retval;
+    }
+    
+    // Elements that are in each sequence exactly once and in the same order in both, the parts between them can be compared separately
+    static inline std::vector<std::pair<int, int>> anchors(const std::vector<int> &first, const std::vector<int> &second)
+    {
+        std::unordered_map<int, std::pair<int, int>> counts;
+        std::unordered_map<int, int> positions;
+        for(int i = 0; i < (int)first.size(); i++) {
+            counts[first[i]].first++;
+            positions[first[i]] = i;
+        }
+        for(int element : second)
+            counts[element].second++;
+        std::vector<std::pair<int, int>> candidates;
+        for(int i = 0; i < (int)second.size(); i++) {
+            auto &count = counts[second[i]];
+            if(count.first == 1 && count.second == 1) candidates.emplace_back(positions[second[i]], i);
+        }
+        // Longest increasing subsequence of positions in the first sequence, by patience sorting
+        std::vector<int> tails;
+        std::vector<int> previous(candidates.size(), -1);
+        for(int i = 0; i < (int)candidates.size(); i++) {
+            auto found = std::lower_bound(tails.begin(), tails.end(), candidates[i].first, [&] (int candidate, int position) {
+                return candidates[candidate].first < position;
+            });
+            if(found != tails.begin()) previous[i] = *(found - 1);
+            if(found == tails.end()) tails.push_back(i);
+            else *found = i;
+        }
+        std::vector<std::pair<int, int>> retval;
+        for(int i = tails.empty() ? -1 : tails.back(); i >= 0; i = previous[i])
+            retval.push_back(candidates[i]);
+        std::reverse(retval.begin(), retval.end());
+        return retval;
+    }
+    
+    // Splits the sequences at anchors and compares the parts between them on several threads.
+    // The result may not be the shortest possible (like with patience diff), but it's usually what a human would expect.
+    static inline std::vector<DiffHunk> compareParallel(const std::vector<int> &first, const std::vector<int> &second, int threads)
+    {
+        std::vector<std::pair<int, int>> anchored = anchors(first, second);
+        anchored.emplace_back(first.size(), second.size());
+        std::vector<std::vector<DiffHunk>> parts(anchored.size());
+        std::atomic<int> next{0};
+        auto work = [&] {
+            for(int i = next++; i < (int)anchored.size(); i = next++) {
+                int firstStart = (i == 0) ? 0 : anchored[i - 1].first + 1;
+                int secondStart = (i == 0) ? 0 : anchored[i - 1].second + 1;
+                compare(first, firstStart, anchored[i].first, second, secondStart, anchored[i].second, parts[i]);
+            }
+        };
+        std::vector<std::thread> workers;
+        for(int i = 1; i < threads; i++)
+            workers.emplace_back(work);
+        work();
+        for(auto &worker : workers)
+            worker.join();
+        std::vector<DiffHunk> retval;
+        for(auto &part : parts)
+            retval.insert(retval.end(), part.begin(), part.end());
+        return retval;
+    }
+};
+
+// Replacement of the text from the starting position up to (but excluding) the ending position,
+// insertions have both positions the same. The replacement can contain line breaks.
+struct SourceEdit {
+    int line = 0;
+    int character = 0;
+    int endLine = 0;
+    int endCharacter = 0;
+    std::string replacement;
+    
+    inline SourceEdit() = default;
+    inline SourceEdit(int line, int character, int endLine, int endCharacter, std::string replacement) :
+        line(line), character(character), endLine(endLine), endCharacter(endCharacter), replacement(std::move(replacement)) {}
+    
+    // Orders by start and then by end, so that insertions come before replacements starting at the same spot
+    inline bool operator<(const SourceEdit &other) const
+    {
+        if(line != other.line) return line < other.line;
+        if(character != other.character) return character < other.character;
+        if(endLine != other.endLine) return endLine < other.endLine;
+        return endCharacter < other.endCharacter;
+    }
+    
+    inline bool overlaps(const SourceEdit &later) const
+    {
+        return later.line < endLine || (later.line == endLine && later.character < endCharacter);
+    }
+};
+
+// How many parts the lines are split into when they are processed by many threads, 0 threads means one per core
+inline int lineRangeCount(int lineCount, int threads)
+{
+    if(threads <= 0) threads = std::max<int>(1, std::thread::hardware_concurrency());
+    return std::max(1, std::min(threads, lineCount));
+}
+
+// The first line of a part of the lines split into the given number of parts, the end of the last part for the number of parts
+inline int lineRangeStart(int lineCount, int ranges, int range)
+{
+    return (long long)lineCount * range / ranges;
+}
+
+// Splits the lines into lineRangeCount() parts of about the same size and calls the function with the index of the part,
+// its first line and its end line, each part from its own thread.
+// Rethrows the first exception thrown by the function after all threads are done.
+template <typename Function>
+inline void runOverLineRanges(int lineCount, int threads, Function function)
+{
+    int ranges = lineRangeCount(lineCount, threads);
+    if(ranges == 1) {
+        function(0, 0, lineCount);
+        return;
+    }
+    std::vector<std::thread> workers;
+    std::exception_ptr failure;
+    std::mutex failureMutex;
+    for(int i = 0; i < ranges; i++) {
+        int firstLine = lineRangeStart(lineCount, ranges, i);
+        int endLine = lineRangeStart(lineCount, ranges, i + 1);
+        workers.emplace_back([&, i, firstLine, endLine] {
+            try {
+                function(i, firstLine, endLine);
+            }
+            catch(...) {
+                std::lock_guard<std::mutex> lock(failureMutex);
+                if(!failure) failure = std::current_exception();
+            }
+        });
+    }
+    for(auto &worker : workers)
+        worker.join();
+    if(failure) std::rethrow_exception(failure);
+}
+
+// Edits collected while searching a source that doesn't change and applied all at once in the end,
+// so that a search can't be misled by its own edits. Edits can be added from many threads at once.
+class EditTransaction {
+    std::vector<SourceEdit> edits;
+    mutable std::mutex mutex;
+    
+public:
+    inline EditTransaction() = default;
+    EditTransaction(const EditTransaction &) = delete;
+    EditTransaction &operator=(const EditTransaction &) = delete;
+    
+    inline void add(SourceEdit edit)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        edits.push_back(std::move(edit));
+    }
+    
+    inline void add(std::vector<SourceEdit> added)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(edits.empty()) edits = std::move(added);
+        else edits.insert(edits.end(), std::make_move_iterator(added.begin()), std::make_move_iterator(added.end()));
+    }
+    
+    inline void replace(int line, int character, int endLine, int endCharacter, std::string replacement)
+    {
+        add(SourceEdit(line, character, endLine, endCharacter, std::move(replacement)));
+    }
+    
+    inline void insert(int line, int character, std::string inserted)
+    {
+        replace(line, character, line, character, std::move(inserted));
+    }
+    
+    inline void erase(int line, int character, int endLine, int endCharacter)
+    {
+        replace(line, character, endLine, endCharacter, "");
+    }
+    
+    inline size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return edits.size();
+    }
+    
+    // The edits in the order they will be applied in
+    inline std::vector<SourceEdit> sorted() const
+    {
+        std::vector<SourceEdit> retval;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            retval = edits;
+        }
+        std::stable_sort(retval.begin(), retval.end());
+        return retval;
+    }
+    
+    // Pairs of edits that overlap, the transaction can be committed only if there are none
+    inline std::vector<std::pair<SourceEdit, SourceEdit>> conflicts() const
+    {
+        std::vector<std::pair<SourceEdit, SourceEdit>> retval;
+        std::vector<SourceEdit> ordered = sorted();
+        int furthest = 0;
+        for(int i = 1; i < (int)ordered.size(); i++) {
+            if(ordered[furthest].overlaps(ordered[i])) retval.emplace_back(ordered[furthest], ordered[i]);
+            const SourceEdit &current = ordered[i];
+            const SourceEdit &previous = ordered[furthest];
+            if(current.endLine > previous.endLine || (current.endLine == previous.endLine && current.endCharacter > previous.endCharacter))
+                furthest = i;
+        }
+        return retval;
+    }
+    
+    // Applies all the edits in one pass over the source and forgets them. If any edits overlap
+    // or are outside the source, it throws and neither the source nor the transaction is changed.
+    template <typename SourceType>
+    inline void commit(SourceType &source)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        source.applyEdits(edits);
+        edits.clear();
+    }
+    
+    // Calls the function from many threads at once, each with a part of the lines, given as the first line and the end line.
+    // Rethrows the first exception thrown by the function after all threads are done.
+    template <typename Function>
+    inline void collectParallel(int lineCount, int threads, Function function)
+    {
+        runOverLineRanges(lineCount, threads, [&] (int, int firstLine, int endLine) {
+            function(firstLine, endLine);
+        });
+    }
+};
+
+// Output iterator calling a function with everything written into it, to take output without storing it
+template <typename Function>
+class FunctionOutput {
+    Function function;
+public:
+    using iterator_category = std::output_iterator_tag;
+    using value_type = void;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = void;
+    
+    inline FunctionOutput(Function function) : function(std::move(function)) {}
+    inline FunctionOutput &operator*() { return *this; }
+    inline FunctionOutput &operator++() { return *this; }
+    inline FunctionOutput &operator++(int) { return *this; }
+    template <typename Value>
+    inline FunctionOutput &operator=(Value &&value)
+    {
+        function(std::forward<Value>(value));
+        return *this;
+    }
+};
+
+template <typename Function>
+inline FunctionOutput<Function> makeFunctionOutput(Function &&function)
+{
+    return FunctionOutput<typename std::decay<Function>::type>(std::forward<Function>(function));
+}
+
+// Bump allocator for pieces of text that can't be views into the source, like list elements spanning lines.
+// A piece is built with begin(), append() and finish(). Views it returned are valid until clear(),
+// which keeps the memory for reuse, so a rewrite loop clearing it on every iteration stops allocating soon.
+class TextArena {
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::vector<size_t> blockSizes;
+    size_t blockSize;
+    size_t block = 0;
+    size_t used = 0;
+    size_t pieceStart = 0;
+
+    // Moves the unfinished piece into a block that can take the additional size
+    inline void grow(size_t additional)
+    {
+        size_t piece = used - pieceStart;
+        size_t needed = std::max(blockSize, (piece + additional) * 2);
+        size_t next = blocks.empty() ? 0 : block + 1;
+        if(next >= blocks.size() || blockSizes[next] < needed) {
+            blocks.emplace(blocks.begin() + next, new char[needed]);
+            blockSizes.emplace(blockSizes.begin() + next, needed);
+        }
+        if(piece > 0) std::memcpy(blocks[next].get(), blocks[block].get() + pieceStart, piece);
+        block = next;
+        pieceStart = 0;
+        used = piece;
+    }
+
+public:
+    inline TextArena(size_t blockSize = 4096) : blockSize(blockSize) {}
+    TextArena(const TextArena &) = delete;
+    TextArena &operator=(const TextArena &) = delete;
+
+    inline void begin()
+    {
+        pieceStart = used;
+    }
+
+    inline void append(std::string_view text)
+    {
+        if(blocks.empty() || used + text.size() > blockSizes[block]) grow(text.size());
+        if(!text.empty()) std::memcpy(blocks[block].get() + used, text.data(), text.size());
+        used += text.size();
+    }
+
+    inline void append(char character)
+    {
+        if(blocks.empty() || used == blockSizes[block]) grow(1);
+        blocks[block][used++] = character;
+    }
+
+    inline std::string_view finish()
+    {
+        if(blocks.empty()) return std::string_view();
+        std::string_view retval(blocks[block].get() + pieceStart, used - pieceStart);
+        pieceStart = used;
+        return retval;
+    }
+
+    inline std::string_view store(std::string_view text)
+    {
+        begin();
+        append(text);
+        return finish();
+    }
+
+    inline void clear()
+    {
+        block = 0;
+        used = 0;
+        pieceStart = 0;
+    }
+
+    // Total memory held, including what is free for reuse
+    inline size_t capacity() const
+    {
+        size_t retval = 0;
+        for(size_t size : blockSizes)
+            retval += size;
+        return retval;
+    }
+};
+
+// The type of lines decides who owns the text. std::string lines can be edited freely,
+// std::string_view lines are views of text kept alive by the storage member (usually a mapped file,
+// so the lines are one contiguous block of memory), which makes loading files that will only be searched very cheap.
+// Lines of views changed by applyEdits are put into a bump allocator kept by the source and freed with it.
+template <typename Line>
+class BasicSource {
     // No encapsulation, it would be impractical to do all through methods.
     // The std::vector and std::string classes' encapsulation grants object consistency.
     // There's no simple way of checking if the represented source code is consistent.
 public:
+    static constexpr bool ownsLines = std::is_same<Line, std::string>::value;
+
+    std::vector<Line> lines;
+    // Whatever the lines point to if they don't own their text, null otherwise
+    std::shared_ptr<const void> storage;
+    
+    // Lines of views written by edits, with the text of earlier edits that was shared with a copy of the source when editing it again
+    struct EditedText {
+        TextArena text;
+        std::shared_ptr<EditedText> previous;
+    };
+    std::shared_ptr<EditedText> editedText;
+    
+    // Taken by value so that a temporary text becomes the storage of views without being copied
+    inline BasicSource(std::string input)
+    {
+        if constexpr(ownsLines) {
+            std::vector<std::string_view> split = splitLines(input);
+            lines.reserve(split.size());
+            for(std::string_view line : split)
+                lines.emplace_back(line);
+        } else {
+            auto buffer = std::make_shared<const std::string>(std::move(input));
+            lines = splitLines(*buffer);
+            storage = buffer;
+        }
+    }
+    inline BasicSource(const std::vector<Line> &lines) : lines(lines) {}
+    inline BasicSource(std::vector<Line> &&lines) : lines(std::move(lines)) {}
+    // Copying a view into a source owning its lines is what has to be done before editing the lines directly
+    template <typename OtherLine, typename = typename std::enable_if<ownsLines && !std::is_same<Line, OtherLine>::value>::type>
+    inline explicit BasicSource(const BasicSource<OtherLine> &other) : lines(other.lines.begin(), other.lines.end()) {}
+    inline BasicSource(const BasicSource &) = default;
+    inline BasicSource(BasicSource &&) = default;
+    inline BasicSource() = default;
+    inline BasicSource &operator=(const BasicSource &) = default;
+    inline BasicSource &operator=(BasicSource &&) = default;
+    
+    static inline BasicSource fromFile(const std::string &fileName)
+    {
+        EDITING_UTILS_PROFILE_SCOPE(FromFile);
+        if constexpr(ownsLines) {
+            std::ifstream input(fileName);
+            if(!input.good()) throw(std::runtime_error("File could not be opened"));
+            BasicSource retval = BasicSource::fromStream(input);
+            EDITING_UTILS_PROFILE_BYTES(retval.textSize());
+            return retval;
+        } else {
+            auto file = std::make_shared<const MappedFile>(fileName);
+            BasicSource retval(splitLines(file->view()));
+            retval.storage = file;
+            EDITING_UTILS_PROFILE_BYTES(file->size());
+            return retval;
+        }
+    }
+    
+    static inline BasicSource fromStream(std::istream &input)
+    {
+        if constexpr(ownsLines) {
+            std::vector<std::string> retval;
+            
+            std::string line;
+            while(std::getline(input, line)) {
+                retval.push_back(std::string());
+                retval.back().swap(line);
+            }
+            return BasicSource(std::move(retval));
+        } else {
+            std::stringstream contents;
+            contents << input.rdbuf();
+            return BasicSource(contents.str());
+        }
+    }
+    
+    // Splits the text the same way std::getline would, the lines are views into the text given
+    static inline std::vector<std::string_view> splitLines(std::string_view text)
+    {
+        std::vector<std::string_view> retval;
+        size_t start = 0;
+        while(start < text.size()) {
+            const void *found = std::memchr(text.data() + start, '\n', text.size() - start);
+            size_t end = found ? static_cast<const char*>(found) - text.data() : text.size();
+            retval.push_back(text.substr(start, end - start));
+            start = end + 1;
+        }
+        return retval;
+    }
+    
+    // Behaves like std::string's operator[] at the end (returns zero there), so that it's safe for views as well
+    static inline char characterAt(const Line &line, int index)
+    {
+        return (index >= 0 && index < (int)line.size()) ? line[index] : '\0';
+    }
+    
+    // Joining lines on one line puts a space between them only where two identifiers would merge
+    inline bool separatedBySpace(size_t line) const
+    {
+        return isValidIdentifierChar(characterAt(lines[line], lines[line].size() - 1)) && isValidIdentifierChar(characterAt(lines[line + 1], 0));
+    }
+    
+    // The exact number of characters toString produces
+    inline size_t outputSize(bool oneLine = false) const
+    {
+        size_t retval = 0;
+        for(size_t i = 0; i < lines.size(); i++) {
+            retval += lines[i].size();
+            if(i + 1 < lines.size() && (!oneLine || separatedBySpace(i))) retval++;
+        }
+        return retval;
+    }
+    
+    inline void appendTo(std::string &output, bool oneLine = false) const
+    {
+        for(size_t i = 0; i < lines.size(); i++) {
+            output.append(lines[i].data(), lines[i].size());
+            if(i + 1 < lines.size()) {
+                if(!oneLine) output.push_back('\n');
+                else if(separatedBySpace(i)) output.push_back(' ');
+            }
+        }
+    }
+    
+    void toStream(std::ostream &output, bool oneLine = false) const
+    {
+        for(size_t i = 0; i < lines.size(); i++) {
+            output.write(lines[i].data(), lines[i].size());
+            if(i + 1 < lines.size()) {
+                if(!oneLine) output.put('\n');
+                else if(separatedBySpace(i)) output.put(' ');
+            }
+        }
+    }
+    
+    // The file is written with one call and only if its contents differ, so rerunning something that changes nothing writes nothing.
+    // The lines don't keep the line break ending a file, so a file differing only by it isn't written either.
+    // Returns whether the file was written.
+    bool toFile(const std::string &fileName, bool oneLine = false, bool report = true) const
+    {
+        EDITING_UTILS_PROFILE_SCOPE(ToFile);
+        EDITING_UTILS_PROFILE_BYTES(textSize());
+        bool written = writeFileIfChanged(fileName, toString(oneLine), true);
+        if(report) {
+            std::lock_guard<std::mutex> lock(reportMutex());
+            std::cout << (written ? "Saved as " : "Already saved as ") << fileName << std::endl;
+        }
+        return written;
+    }
+    
+    // The number of characters including line breaks
+    inline size_t textSize() const
+    {
+        size_t retval = 0;
+        for(auto &line : lines)
+            retval += line.size() + 1;
+        return retval;
+    }
+    
+    // Guards reports printed to std::cout, so that they don't interleave when files are processed in parallel
+    static inline std::mutex &reportMutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+    
+    // Written into a buffer allocated once with the exact size
+    std::string toString(bool oneLine = false) const
+    {
+        std::string retval;
+        retval.reserve(outputSize(oneLine));
+        appendTo(retval, oneLine);
+        return retval;
+    }
+    
+    static constexpr bool isValidIdentifierChar(const char character)
+    {
+        return isIdentifierChar(character);
+    }
+    
+    inline int skipWhitespace(int line, int character) const
+    {
+        const Line &ln = lines[line];
+        char current = characterAt(ln, character);
+        if(current == ' ' || current == '\t' || current == '\r') {
+            if(character != 0 && (isValidIdentifierChar(ln[character - 1]) && isValidIdentifierChar(characterAt(ln, character + 1)))) {
+                return character;
+            }
+            return CharacterScanner::findNonWhitespace(ln.data(), ln.size(), character);
+        }
+        return character;
+    }
+    
+    inline int skipWhitespaceLines(int line) const
+    {
+        while(line < (int)lines.size()) {
+            if(CharacterScanner::findNonWhitespace(lines[line].data(), lines[line].size()) < lines[line].size())
+                return line;
+            line++;
+        }
+        return lines.size() - 1;
+    }
+    
+    inline int findNextLineContaining(const std::string &sought, int line) const
+    {
+        while(line < (int)lines.size() && lines[line].find(sought) == Line::npos)
+            line++;
+        return line;
+    }
+    
+    inline int goBackLine(int &line) const
+    {
+        line--;
+        if(line < 0) throw(std::runtime_error("Nothing interesting before the location"));
+        size_t found = lines[line].find("//");
+        if(found == Line::npos) found = lines[line].size();
+        return int(found) - 1;
+    }
+    
+    // The function given receives line index, letter index of the occurrence and whether it's all on one line
+    // and must return the line index where it will restart its search on
+    // The expression sought after should have spaces only where necessary
+    // It is assumed that the new line number will not be set somewhere where it can match the result of edits
+    inline void iterateThroughOccurrences(const std::string &sought, std::function<int(int, int, bool)> callback) const
+    {
+        EDITING_UTILS_PROFILE_SCOPE(IterateThroughOccurrences);
+        EDITING_UTILS_PROFILE_BYTES(textSize());
+        findOccurrences(sought, 0, lines.size(), [&] (const Occurrence &found) {
+            EDITING_UTILS_PROFILE_MATCH();
+            profiledCall(callback, found.line, found.character, found.oneLine);
+        });
+    }
+    
+    // Where an occurrence was found, the end is right after its last character and the position
+    // is where iterateThroughOccurrences reports it (after the whitespace following it)
+    struct Occurrence {
+        int pattern = 0;
+        int startLine = 0;
+        int startCharacter = 0;
+        int endLine = 0;
+        int endCharacter = 0;
+        int line = 0;
+        int character = 0;
+        bool oneLine = true;
+    };
+    
+    // Finds the occurrences starting on lines from the first one till the end one (excluding it), like iterateThroughOccurrences.
+    // The lexer state at the first line is found by lexing the lines before it.
+    template <typename Found>
+    inline void findOccurrences(const std::string &sought, int firstLine, int endLine, Found found) const
+    {
+        Lexer::State state = lexerState(0, firstLine);
+        findOccurrences(sought, firstLine, endLine, found, state);
+    }
+    
+    // The state of the lexer at the start of the end line, if it's in the given state at the start of the first line
+    inline Lexer::State lexerState(int firstLine, int endLine, Lexer::State state = Lexer::State()) const
+    {
+        for(int i = firstLine; i < endLine; i++)
+            Lexer::scanLine(lines[i], state, [] (int, int, Lexer::Kind) { return true; });
+        return state;
+    }
+    
+    // The state is updated to the one at the start of the end line
+    template <typename Found>
+    inline void findOccurrences(const std::string &sought, int firstLine, int endLine, Found found, Lexer::State &state) const
+    {
+        Occurrence occurrence;
+        // Occurrences starting before this on the current line were reported before the line was edited
+        int resume = 0;
+        for(int i = firstLine; i < endLine && i < (int)lines.size(); i++) {
+            const char *data = lines[i].data();
+            int size = lines[i].size();
+            Lexer::State lineStart = state;
+            bool edited = false;
+            // Whitespace is skipped while matching unless the occurrence starts in a literal (before its closing quote)
+            bool completed = Lexer::scanLine(data, size, state, [&] (int start, int end, Lexer::Kind kind) {
+                bool stringLiteral = Lexer::isLiteral(kind) && kind != Lexer::StringEnd && kind != Lexer::CharacterEnd;
+                for(int j = std::max(start, resume); j < end; j++) {
+                    const void *candidate = std::memchr(data + j, sought[0], end - j);
+                    if(!candidate) break;
+                    j = static_cast<const char*>(candidate) - data;
+                    int line = i;
+                    int character = j;
+                    int passed = 0;
+                    bool oneLine = true;
+                    while(passed < (int)sought.size() && characterAt(lines[line], character) == sought[passed]) {
+                        character++;
+                        passed++;
+                        occurrence.endLine = line;
+                        occurrence.endCharacter = character;
+                        if(!stringLiteral) character = skipWhitespace(line, character);
+                        if(character >= (int)lines[line].size() && !isValidIdentifierChar(sought[passed])) {
+                            // An occurrence ending at the end of the text is reported there
+                            if(line + 1 >= (int)lines.size()) {
+                                if(passed < (int)sought.size()) return false;
+                                break;
+                            }
+                            oneLine = false;
+                            line++;
+                            character = stringLiteral ? 0 : skipWhitespace(line, 0);
+                        }
+                    }
+                    if(passed >= (int)sought.size()) {
+                        occurrence.startLine = i;
+                        occurrence.startCharacter = j;
+                        occurrence.line = line;
+                        occurrence.character = character;
+                        occurrence.oneLine = oneLine;
+                        found(occurrence);
+                        // If the callback changed the line, it's lexed again and searched after this occurrence
+                        if(changed(i, data, size)) {
+                            resume = j + 1;
+                            edited = true;
+                            return false;
+                        }
+                    }
+                }
+                return true;
+            });
+            if(edited) {
+                state = lineStart;
+                i--;
+                continue;
+            }
+            resume = 0;
+            if(!completed) return;
+        }
+    }
+    
+    // Whether the line was resized, moved or removed since its text was at the given address
+    inline bool changed(int line, const char *data, int size) const
+    {
+        return line >= (int)lines.size() || lines[line].data() != data || (int)lines[line].size() != size;
+    }
+    
+    // Like iterateThroughOccurrences, but the lines are split into ranges searched by many threads (0 means one per core).
+    // Every range is searched as if it started in code, which is nearly always so; the ranges that turn out to start
+    // in a literal or a comment are searched again. The callback is called from the calling thread with all the occurrences
+    // in the order of the source. Like in the sequential version, the return value of the callback is not used.
+    inline void iterateThroughOccurrencesParallel(const std::string &sought, std::function<int(int, int, bool)> callback, int threads = 0) const
+    {
+        EDITING_UTILS_PROFILE_SCOPE(IterateThroughOccurrences);
+        EDITING_UTILS_PROFILE_BYTES(textSize());
+        int ranges = lineRangeCount(lines.size(), threads);
+        if(ranges == 1) {
+            findOccurrences(sought, 0, lines.size(), [&] (const Occurrence &found) {
+                EDITING_UTILS_PROFILE_MATCH();
+                profiledCall(callback, found.line, found.character, found.oneLine);
+            });
+            return;
+        }
+        std::vector<std::vector<Occurrence>> occurrences(ranges);
+        std::vector<Lexer::State> rangeEnds(ranges);
+        auto search = [&] (int range, Lexer::State &state) {
+            occurrences[range].clear();
+            findOccurrences(sought, lineRangeStart(lines.size(), ranges, range), lineRangeStart(lines.size(), ranges, range + 1), [&] (const Occurrence &found) {
+                occurrences[range].push_back(found);
+            }, state);
+        };
+        runOverLineRanges(lines.size(), ranges, [&] (int range, int, int) {
+            search(range, rangeEnds[range]);
+        });
+        Lexer::State state = rangeEnds[0];
+        for(int range = 1; range < ranges; range++) {
+            if(state != Lexer::State()) search(range, state);
+            else state = rangeEnds[range];
+        }
+        for(const std::vector<Occurrence> &inRange : occurrences) {
+            for(const Occurrence &found : inRange) {
+                EDITING_UTILS_PROFILE_MATCH();
+                profiledCall(callback, found.line, found.character, found.oneLine);
+            }
+        }
+    }
+    
+    // Like findNextLineContaining, with the lines after the given one split into ranges searched by many threads.
+    // Threads stop searching once a line found by another thread is before theirs.
+    inline int findNextLineContainingParallel(const std::string &sought, int line, int threads = 0) const
+    {
+        if(line >= (int)lines.size()) return line;
+        line = std::max(line, 0);
+        std::atomic<int> found(lines.size());
+        runOverLineRanges(lines.size() - line, threads, [&] (int, int firstLine, int endLine) {
+            for(int i = line + firstLine; i < line + endLine && i < found.load(std::memory_order_relaxed); i++) {
+                if(lines[i].find(sought) != Line::npos) {
+                    int earliest = found.load();
+                    while(i < earliest && !found.compare_exchange_weak(earliest, i));
+                    return;
+                }
+            }
+        });
+        return found;
+    }
+    
+    // Instead of changing the lines, the callback returns the edits to make at each occurrence (a std::vector<SourceEdit>)
+    // and they are added to the transaction, to be applied all at once when the search is over.
+    // Only the occurrences starting in the given range of lines are searched, so that ranges can be searched in parallel.
+    template <typename Callback>
+    inline void collectEdits(const std::string &sought, EditTransaction &transaction, Callback callback, int firstLine = 0, int endLine = -1) const
+    {
+        if(endLine < 0 || endLine > (int)lines.size()) endLine = lines.size();
+        std::vector<SourceEdit> collected;
+        findOccurrences(sought, firstLine, endLine, [&] (const Occurrence &found) {
+            for(SourceEdit &edit : callback(found))
+                collected.push_back(std::move(edit));
+        });
+        transaction.add(std::move(collected));
+    }
+    
+    template <typename Callback>
+    inline void collectEdits(const PatternSet &patterns, EditTransaction &transaction, Callback callback) const
+    {
+        std::vector<SourceEdit> collected;
+        findOccurrences(patterns, [&] (const Occurrence &found) {
+            for(SourceEdit &edit : callback(found))
+                collected.push_back(std::move(edit));
+            return found.line;
+        });
+        transaction.add(std::move(collected));
+    }
+    
+#if __cplusplus >= 202002L
+    // The same as the single pattern version, but specialised for a pattern known while compiling.
+    // Candidates are rejected early by the second character where possible
+    // and the callback is not wrapped in std::function, so it can be inlined.
+    template <FixedPattern Pattern, typename Callback>
+    inline void iterateThroughOccurrences(Callback &&callback) const
+    {
+        static_assert(Pattern.size > 0, "The pattern can't be empty");
+        constexpr char first = Pattern.text[0];
+        constexpr std::array<bool, Pattern.size + 1> lineBreaks = Pattern.lineBreaks();
+        EDITING_UTILS_PROFILE_SCOPE(IterateThroughOccurrences);
+        EDITING_UTILS_PROFILE_BYTES(textSize());
+        Lexer::State state;
+        int resume = 0;
+        for(int i = 0; i < (int)lines.size(); i++) {
+            const char *data = lines[i].data();
+            int size = lines[i].size();
+            Lexer::State lineStart = state;
+            bool edited = false;
+            bool completed = Lexer::scanLine(data, size, state, [&] (int start, int end, Lexer::Kind kind) {
+                bool stringLiteral = Lexer::isLiteral(kind) && kind != Lexer::StringEnd && kind != Lexer::CharacterEnd;
+                for(int j = std::max(start, resume); j < end; j++) {
+                    const void *candidate = std::memchr(data + j, first, end - j);
+                    if(!candidate) break;
+                    j = static_cast<const char*>(candidate) - data;
+                    // Most candidates fail on the next character, without any whitespace to skip or a line end to cross
+                    if constexpr(Pattern.size > 1) {
+                        char second = (j + 1 < size) ? data[j + 1] : '\0';
+                        if(j + 1 < size && second != Pattern.text[1] && second != ' ' && second != '\t' && second != '\r') continue;
+                    }
+                    int line = i;
+                    int character = j;
+                    int passed = 0;
+                    bool oneLine = true;
+                    while(passed < Pattern.size && characterAt(lines[line], character) == Pattern.text[passed]) {
+                        character++;
+                        passed++;
+                        if(!stringLiteral) character = skipWhitespace(line, character);
+                        if(lineBreaks[passed] && character >= (int)lines[line].size()) {
+                            if(line + 1 >= (int)lines.size()) {
+                                if(passed < Pattern.size) return false;
+                                break;
+                            }
+                            oneLine = false;
+                            line++;
+                            character = stringLiteral ? 0 : skipWhitespace(line, 0);
+                        }
+                    }
+                    if(passed >= Pattern.size) {
+                        EDITING_UTILS_PROFILE_MATCH();
+                        profiledCall(callback, line, character, oneLine);
+                        if(changed(i, data, size)) {
+                            resume = j + 1;
+                            edited = true;
+                            return false;
+                        }
+                    }
+                }
+                return true;
+            });
+            if(edited) {
+                state = lineStart;
+                i--;
+                continue;
+            }
+            resume = 0;
+            if(!completed) return;
+        }
+    }
+#endif
+    
+    // Finds all the patterns at once, the callback receives the index of the pattern before the arguments
+    // it would receive from the single pattern version and its return value has the same meaning.
+    // The search never goes back, a line before the current one (or a negative one) continues on the current line.
+    // The occurrences come ordered by where they end (by pattern index if they end at the same spot)
+    // and unlike in the single pattern version, an occurrence ending at the end of a line is reported there.
+    inline void iterateThroughOccurrences(const PatternSet &patterns, std::function<int(int, int, int, bool)> callback) const
+    {
+        EDITING_UTILS_PROFILE_SCOPE(IterateThroughOccurrences);
+        EDITING_UTILS_PROFILE_BYTES(textSize());
+        findOccurrences(patterns, [&] (const Occurrence &found) {
+            EDITING_UTILS_PROFILE_MATCH();
+            return profiledCall(callback, found.pattern, found.line, found.character, found.oneLine);
+        });
+    }
+    
+    // The function given receives the Occurrence and returns the line to continue on, like the callback of iterateThroughOccurrences
+    template <typename Found>
+    inline void findOccurrences(const PatternSet &patterns, Found found) const
+    {
+        Occurrence occurrence;
+        // Positions of the last characters that were matched against, whitespace that can be skipped is not there
+        int window = patterns.longest();
+        std::vector<std::pair<int, int>> recent(window);
+        long long consumed = 0;
+        // Where in recent the next character goes, kept apart so that there's no division for every character
+        int position = 0;
+        int state = 0;
+        Lexer::State lexer;
+        // Occurrences ending before this on the current line were reported before the line was edited
+        int resume = 0;
+        struct Run {
+            int start;
+            int end;
+            bool literal;
+        };
+        std::vector<Run> runs;
+        for(int i = 0; i < (int)lines.size(); i++) {
+            const char *data = lines[i].data();
+            int size = lines[i].size();
+            Lexer::State lineStart = lexer;
+            bool anyConsumed = false;
+            int restartLine = -1;
+            // The line is lexed first and its runs are searched after, so that the state of the search stays in registers
+            runs.clear();
+            Lexer::scanLine(data, size, lexer, [&] (int start, int end, Lexer::Kind kind) {
+                runs.push_back(Run{start, end, Lexer::isLiteral(kind)});
+                return true;
+            });
+            for(size_t r = 0; r < runs.size() && restartLine < 0; r++) {
+                bool stringLiteral = runs[r].literal;
+                int end = runs[r].end;
+                for(int j = runs[r].start; j < end; j++) {
+                    // Characters that leave the automaton at the start can't be a part of any occurrence
+                    if(state == 0) {
+                        while(j < end && patterns.next(0, data[j]) == 0) j++;
+                        if(j == end) break;
+                    }
+                    char current = data[j];
+                    if(!stringLiteral && (current == ' ' || current == '\t' || current == '\r')
+                            && !(j != 0 && isValidIdentifierChar(data[j - 1]) && j + 1 < size && isValidIdentifierChar(data[j + 1])))
+                        continue;
+                    anyConsumed = true;
+                    state = patterns.next(state, current);
+                    recent[position] = std::make_pair(i, j);
+                    if(++position == window) position = 0;
+                    consumed++;
+                    if(j < resume) continue;
+                    for(int matched : patterns.matched(state)) {
+                        const std::string &pattern = patterns.patterns[matched];
+                        // A match can continue on the next line only before a character that can't be a part of an identifier
+                        bool valid = true;
+                        for(int k = 1; k < (int)pattern.size() && valid; k++) {
+                            if(recent[(consumed - pattern.size() + k) % window].first != recent[(consumed - pattern.size() + k - 1) % window].first
+                                    && isValidIdentifierChar(pattern[k]))
+                                valid = false;
+                        }
+                        if(!valid) continue;
+                        occurrence.pattern = matched;
+                        occurrence.startLine = recent[(consumed - pattern.size()) % window].first;
+                        occurrence.startCharacter = recent[(consumed - pattern.size()) % window].second;
+                        occurrence.endLine = i;
+                        occurrence.endCharacter = j + 1;
+                        occurrence.line = i;
+                        occurrence.character = stringLiteral ? j + 1 : skipWhitespace(i, j + 1);
+                        occurrence.oneLine = occurrence.startLine == i;
+                        int newLine = std::min<int>(std::max(found(occurrence), i), lines.size());
+                        // A changed line is lexed again and searched after this occurrence
+                        if(newLine != i || changed(i, data, size)) {
+                            restartLine = newLine;
+                            resume = (newLine == i) ? j + 1 : 0;
+                            break;
+                        }
+                    }
+                    if(restartLine >= 0) break;
+                }
+            }
+            if(restartLine >= 0) {
+                lexer = lexerState(i, restartLine, lineStart);
+                i = restartLine - 1;
+                state = 0;
+                continue;
+            }
+            resume = 0;
+            // Occurrences can't span over empty lines or line ends inside literals
+            if(!anyConsumed || lexer.inLiteral()) state = 0;
+        }
+    }
+    
+    // Calls a callback given by the user, timed separately when profiling
+    template <typename Function, typename... Arguments>
+    static inline auto profiledCall(Function &callback, Arguments... arguments)
+    {
+        EDITING_UTILS_PROFILE_SCOPE(Callback);
+        return callback(arguments...);
+    }
+    
+    // When at some spot where something is written, this will find the variable the element is assigned to
+    // or throws exception on failure
+    inline std::string whatIsItAssignedTo(int line, int character) const
+    {
+        return std::string(whatIsItAssignedToView(line, character));
+    }
+    
+    // The same as whatIsItAssignedTo, but the name is a view into the line
+    inline std::string_view whatIsItAssignedToView(int line, int character) const
+    {
+        while(characterAt(lines[line], character) != '=') {
+            character--;
+            if(character < 0) {
+                character = goBackLine(line);
+            }
+        }
+        while(!isValidIdentifierChar(characterAt(lines[line], character))) {
+            character--;
+            if(character < 0) {
+                character = goBackLine(line);
+            }
+            if(characterAt(lines[line], character) == ';') throw(std::runtime_error("Semicolon ; before assignment (can possibly be in a lambda)"));
+        }
+        int end = character;
+        while(character > 0 && isValidIdentifierChar(lines[line][character])) {
+            character--;
+        }
+        return std::string_view(lines[line]).substr(character + 1, end - character);
+    }
+    
+    // Separators and brackets in literals and comments are a part of the elements
+    inline std::vector<std::string> parseList(int line, int character, char separator, char ender, char opener = 0) const
+    {
+        EDITING_UTILS_PROFILE_SCOPE(ParseList);
+        int depth = 0;
+        std::vector<std::string> retval{""};
+        Lexer::State state;
+        while(true) {
+            const Line &text = lines[line];
+            int from = std::min<int>(std::max(character, 0), text.size());
+            const char *data = text.data() + from;
+            EDITING_UTILS_PROFILE_BYTES(text.size() - from);
+            bool completed = Lexer::scanLine(data, text.size() - from, state, [&] (int start, int end, Lexer::Kind kind) {
+                if(kind != Lexer::Code) {
+                    retval.back().append(data + start, end - start);
+                    return true;
+                }
+                for(int j = start; j < end; j++) {
+                    char current = data[j];
+                    if(current == opener) {
+                        depth++;
+                        retval.back().push_back(opener);
+                    }
+                    else if(current == ender) {
+                        if(depth > 0) retval.back().push_back(ender);
+                        depth--;
+                        if(depth < 0) return false;
+                    }
+                    else if(retval.back().size() == 0 && (current == ' ' || current == '\t' || current == '\r')) {}
+                    else if(depth == 0 && current == separator) {
+                        EDITING_UTILS_PROFILE_MATCH();
+                        retval.push_back("");
+                    }
+                    else {
+                        retval.back().push_back(current);
+                    }
+                }
+                return true;
+            });
+            if(!completed) return retval;
+            line++;
+            if(line >= (int)lines.size()) return retval;
+            if(!state.inLiteral()) character = skipWhitespace(line, 0);
+            else {
+                character = 0;
+                retval.back().push_back('\n');
+            }
+        }
+    }
+    
+    // The same as parseList, but the elements are written as string views into the output iterator. They point into the lines
+    // if the element is on a single line, elements spanning more lines are joined in the arena.
+    template <typename Output>
+    inline Output parseList(Output output, TextArena &arena, int line, int character, char separator, char ender, char opener = 0) const
+    {
+        EDITING_UTILS_PROFILE_SCOPE(ParseList);
+        int depth = 0;
+        Lexer::State state;
+        int elementLine = line;
+        int elementStart = 0;
+        int elementLength = 0;
+        bool inArena = false;
+        auto add = [&] (char current) {
+            bool inLine = character < (int)lines[line].size();
+            if(!inArena && elementLength == 0 && inLine) {
+                elementLine = line;
+                elementStart = character;
+                elementLength = 1;
+                return;
+            }
+            if(!inArena && inLine && line == elementLine && character == elementStart + elementLength) {
+                elementLength++;
+                return;
+            }
+            if(!inArena) {
+                arena.begin();
+                arena.append(std::string_view(lines[elementLine]).substr(elementStart, elementLength));
+                inArena = true;
+            }
+            arena.append(current);
+        };
+        auto finishElement = [&] {
+            if(inArena) *output++ = arena.finish();
+            else if(elementLength == 0) *output++ = std::string_view();
+            else *output++ = std::string_view(lines[elementLine]).substr(elementStart, elementLength);
+            elementLength = 0;
+            inArena = false;
+        };
+        while(true) {
+            const Line &text = lines[line];
+            int from = std::min<int>(std::max(character, 0), text.size());
+            EDITING_UTILS_PROFILE_BYTES(text.size() - from);
+            bool completed = Lexer::scanLine(text.data() + from, text.size() - from, state, [&] (int start, int end, Lexer::Kind kind) {
+                for(character = from + start; character < from + end; character++) {
+                    char current = text[character];
+                    if(kind != Lexer::Code) add(current);
+                    else if(current == opener) {
+                        depth++;
+                        add(opener);
+                    }
+                    else if(current == ender) {
+                        if(depth > 0) add(ender);
+                        depth--;
+                        if(depth < 0) return false;
+                    }
+                    else if(!inArena && elementLength == 0 && (current == ' ' || current == '\t' || current == '\r')) {}
+                    else if(depth == 0 && current == separator) {
+                        EDITING_UTILS_PROFILE_MATCH();
+                        finishElement();
+                    }
+                    else {
+                        add(current);
+                    }
+                }
+                return true;
+            });
+            if(!completed) break;
+            line++;
+            if(line >= (int)lines.size()) break;
+            if(!state.inLiteral()) character = skipWhitespace(line, 0);
+            else {
+                character = 0;
+                if(!inArena) {
+                    arena.begin();
+                    arena.append(std::string_view(lines[elementLine]).substr(elementStart, elementLength));
+                    inArena = true;
+                }
+                arena.append('\n');
+            }
+        }
+        finishElement();
+        return output;
+    }
+    
+    static inline std::string getStringLiteral(const std::string &source)
+    {
+        std::string retval;
+        getStringLiteral(std::string_view(source), makeFunctionOutput([&] (std::string_view literal) { retval.append(literal); }));
+        return retval;
+    }
+    
+    // Writes the contents of the string literals as views into the source, the original joins them together
+    template <typename Output>
+    static inline Output getStringLiteral(std::string_view source, Output output)
+    {
+        // Literals not closed on their line end before the line break
+        int start = -1;
+        int contentEnd = 0;
+        Lexer::State state;
+        Lexer::scan(source.data(), source.size(), state, [&] (int runStart, int runEnd, Lexer::Kind kind) {
+            if(kind == Lexer::String) contentEnd = runEnd;
+            else if(kind == Lexer::StringStart) {
+                if(start >= 0) *output++ = source.substr(start, contentEnd - start);
+                start = runEnd;
+                contentEnd = runEnd;
+            }
+            else if(kind == Lexer::StringEnd && start >= 0) {
+                *output++ = source.substr(start, runStart - start);
+                start = -1;
+            }
+            return true;
+        });
+        if(start >= 0) *output++ = source.substr(start, contentEnd - start);
+        return output;
+    }
+    
+    // A view into the source if there is only one literal, the literals are joined in the arena otherwise
+    static inline std::string_view getStringLiteral(std::string_view source, TextArena &arena)
+    {
+        std::array<std::string_view, 2> first;
+        int count = 0;
+        bool joining = false;
+        getStringLiteral(source, makeFunctionOutput([&] (std::string_view literal) {
+            if(count < 2) first[count] = literal;
+            else if(count == 2) {
+                arena.begin();
+                arena.append(first[0]);
+                arena.append(first[1]);
+                joining = true;
+            }
+            if(count >= 2) arena.append(literal);
+            count++;
+        }));
+        if(count == 0) return std::string_view();
+        if(count == 1) return first[0];
+        if(!joining) {
+            arena.begin();
+            arena.append(first[0]);
+            arena.append(first[1]);
+        }
+        return arena.finish();
+    }
+    
+    void findEndOfList(int &line, int &character, char starting, char ending, int startingDepth = 0) const
+    {
+        int depth = startingDepth;
+        for(; line < (int)lines.size(); line++) {
+            for(; character < (int)lines[line].size(); character++) {
+                char current = lines[line][character];
+                if(current == starting) {
+                    depth++;
+                }
+                else if(current == ending) {
+                    depth--;
+                    if(depth == 0) return;
+                }
+                //else if(current == ';') throw(std::runtime_error("Semicolon ; found before end of list"));
+            }
+            character = 0;
+        }
+        throw(std::runtime_error("End of list not found"));
+    }
+    
+    std::string getTillEndOfList(int line, int character, char starting, char ending, int startingDepth = 0) const
+    {
+        int endLine = line;
+        int endChar = character;
+        findEndOfList(endLine, endChar, starting, ending, startingDepth);
+        return getTillPosition(line, character, endLine, endChar);
+    }
+    
+    // The text from a position till another one, leading whitespace of lines is left out
+    std::string getTillPosition(int line, int character, int endLine, int endChar) const
+    {
+        std::string retval((line == endLine) ? lines[line].substr(character, endChar - character) : lines[line].substr(character));
+        for(int k = 1; k < endLine - line + 1; k++) {
+            int startAt = skipWhitespace(line + k, 0);
+            if(k < endLine - line - 2)
+                retval.append(lines[line + k].substr(startAt));
+            else
+                retval.append(lines[line + k].substr(startAt, endChar - startAt));
+        }
+        return retval;
+    }
+    
+    // The same as getTillEndOfList, but gives a view into the line if the list ends on the same line
+    std::string_view getTillEndOfList(TextArena &arena, int line, int character, char starting, char ending, int startingDepth = 0) const
+    {
+        int endLine = line;
+        int endChar = character;
+        findEndOfList(endLine, endChar, starting, ending, startingDepth);
+        return getTillPosition(arena, line, character, endLine, endChar);
+    }
+    
+    std::string_view getTillPosition(TextArena &arena, int line, int character, int endLine, int endChar) const
+    {
+        if(line == endLine) return std::string_view(lines[line]).substr(character, endChar - character);
+        arena.begin();
+        arena.append(std::string_view(lines[line]).substr(character));
+        for(int k = 1; k < endLine - line + 1; k++) {
+            int startAt = skipWhitespace(line + k, 0);
+            if(k < endLine - line - 2)
+                arena.append(std::string_view(lines[line + k]).substr(startAt));
+            else
+                arena.append(std::string_view(lines[line + k]).substr(startAt, endChar - startAt));
+        }
+        return arena.finish();
+    }
+    
+    static inline std::string removeConst(const std::string &from)
+    {
+        std::string retval;
+        const char *reading = from.c_str();
+        while(*reading) {
+            if(*reading == 'c' && *(reading + 1) == 'o' && *(reading + 2) == 'n' && *(reading + 3) == 's'
+                    && *(reading + 4) == 't' && (*(reading + 5) == ' ' || *(reading + 5) == '\t'))
+                reading += 6;
+            else {
+                retval.push_back(*reading);
+                reading++;
+            }
+        }
+        return retval;
+    }
+    
+    static inline std::string removeReference(const std::string &from)
+    {
+        std::string retval;
+        const char *reading = from.c_str();
+        while(*reading) {
+            if(*reading == '&') {}
+            else if(*reading == ' ' && *(reading + 1) == '&') {}
+            else
+                retval.push_back(*reading);
+            reading++;
+        }
+        return retval;
+    }
+    
+    // Writes the characters removeConst would keep into the output iterator
+    template <typename Output>
+    static inline Output removeConst(std::string_view from, Output output)
+    {
+        size_t size = std::min(from.size(), from.find('\0'));
+        for(size_t reading = 0; reading < size; reading++) {
+            if(from.compare(reading, 5, "const") == 0 && reading + 5 < size && (from[reading + 5] == ' ' || from[reading + 5] == '\t'))
+                reading += 5;
+            else
+                *output++ = from[reading];
+        }
+        return output;
+    }
+    
+    // No copy is made if there is nothing to remove
+    static inline std::string_view removeConst(std::string_view from, TextArena &arena)
+    {
+        size_t found = from.find("const");
+        if(found == std::string_view::npos && from.find('\0') == std::string_view::npos) return from;
+        arena.begin();
+        removeConst(from, makeFunctionOutput([&] (char character) { arena.append(character); }));
+        return arena.finish();
+    }
+    
+    template <typename Output>
+    static inline Output removeReference(std::string_view from, Output output)
+    {
+        size_t size = std::min(from.size(), from.find('\0'));
+        for(size_t reading = 0; reading < size; reading++) {
+            if(from[reading] == '&') {}
+            else if(from[reading] == ' ' && reading + 1 < size && from[reading + 1] == '&') {}
+            else
+                *output++ = from[reading];
+        }
+        return output;
+    }
+    
+    static inline std::string_view removeReference(std::string_view from, TextArena &arena)
+    {
+        if(from.find('&') == std::string_view::npos && from.find('\0') == std::string_view::npos) return from;
+        arena.begin();
+        removeReference(from, makeFunctionOutput([&] (char character) { arena.append(character); }));
+        return arena.finish();
+    }
+    
+    // Normalises one line like normaliseLine, continuing in the given lexer state, in one pass over the runs of the lexer.
+    // Whitespace ending a run of code is decided when the next run that isn't a comment is seen.
+    static inline void normaliseCode(const char *data, int size, Lexer::State &state, std::string &output)
+    {
+        // The last character before the current run with the comments removed
+        char previous = '\0';
+        bool pending = false;
+        char beforePending = '\0';
+        auto keepsSpace = [] (char before, char after) {
+            return isValidIdentifierChar(before) && isValidIdentifierChar(after);
+        };
+        Lexer::scanLine(data, size, state, [&] (int start, int end, Lexer::Kind kind) {
+            if(kind == Lexer::Comment) return true;
+            if(pending && keepsSpace(beforePending, data[start])) output.push_back(' ');
+            pending = false;
+            bool literal = Lexer::isLiteral(kind);
+            // Only whitespace needs attention, what is between it is copied in bulk. Indentation is never kept, so it's skipped at once.
+            int copied = start;
+            if(start == 0 && !literal)
+                while(copied < end && (data[copied] == ' ' || data[copied] == '\t' || data[copied] == '\r')) copied++;
+            int searched = copied;
+            CharacterScanner::forEachOf(data + searched, end - searched, ' ', '\t', '\r', ' ', [&] (int found) {
+                int i = searched + found;
+                output.append(data + copied, i - copied);
+                copied = i + 1;
+                char before = (i > start) ? data[i - 1] : previous;
+                if(data[i] == '\r') return true;
+                if(literal) output.push_back(' ');
+                else if(i + 1 == end) {
+                    pending = true;
+                    beforePending = before;
+                }
+                else if(keepsSpace(before, data[i + 1])) output.push_back(' ');
+                return true;
+            });
+            output.append(data + copied, end - copied);
+            previous = data[end - 1];
+            return true;
+        });
+    }
+    
+    // Removes the comments and the whitespace that isn't needed, whitespace is kept only in literals and as a single space between identifiers
+    static inline std::string normaliseLine(const std::string &input)
+    {
+        std::string retval;
+        retval.reserve(input.size());
+        Lexer::State state;
+        normaliseCode(input.data(), input.size(), state, retval);
+        return retval;
+    }
+    
+    // The original line numbers of the remaining lines are added to the vector if it's given
+    static inline BasicSource<std::string> cleanAll(const BasicSource &input, std::vector<int> *originalLines = nullptr)
+    {
+        EDITING_UTILS_PROFILE_SCOPE(CleanAll);
+        EDITING_UTILS_PROFILE_BYTES(input.textSize());
+        std::vector<std::string> retval;
+        Lexer::State state;
+        for(int i = 0; i < (int)input.lines.size(); i++) {
+            const Line &original = input.lines[i];
+            std::string line;
+            normaliseCode(original.data(), original.size(), state, line);
+            if(!line.empty()) {
+                retval.push_back(std::move(line));
+                if(originalLines) originalLines->push_back(i);
+            }
+        }
+        return BasicSource<std::string>(std::move(retval));
+    }
+    
+    // Returns a copy with the edits applied, the positions of all edits refer to the text before any of them was made,
+    // so positions found by searching stay valid however many edits there are. It's done in one pass over the text.
+    // Throws if the edits overlap or are outside the source.
+    inline BasicSource<std::string> withEdits(std::vector<SourceEdit> edits) const
+    {
+        std::stable_sort(edits.begin(), edits.end());
+        return BasicSource<std::string>(editedLines(lines, edits));
+    }
+    
+    // Same as withEdits, but untouched lines are moved instead of being copied.
+    // Views keep pointing to the same text if their lines are untouched, changed lines are written into editedText.
+    inline void applyEdits(std::vector<SourceEdit> edits)
+    {
+        std::stable_sort(edits.begin(), edits.end());
+        if constexpr(ownsLines) lines = editedLines(lines, edits);
+        else {
+            // Text shared with copies is never written into, the copies could be edited at the same time
+            if(!editedText || editedText.use_count() > 1) {
+                auto created = std::make_shared<EditedText>();
+                created->previous = std::move(editedText);
+                editedText = std::move(created);
+            }
+            lines = editedLines<std::string_view>(lines, edits, &editedText->text);
+        }
+    }
+    
+    // Puts the text of all lines into a single buffer again, so that scans over many lines are sequential after many edits
+    // and text of edited lines that are no longer used is freed
+    inline void compact()
+    {
+        static_assert(!ownsLines, "Only views can be compacted");
+        auto buffer = std::make_shared<std::string>();
+        buffer->reserve(textSize());
+        for(auto &line : lines) {
+            buffer->append(line.data(), line.size());
+            buffer->push_back('\n');
+        }
+        size_t start = 0;
+        for(auto &line : lines) {
+            line = std::string_view(buffer->data() + start, line.size());
+            start += line.size() + 1;
+        }
+        storage = buffer;
+        editedText = nullptr;
+    }
+    
+    // The edits must be sorted, untouched lines are moved out of the original if it's not const.
+    // The lines can be views, then untouched lines keep pointing where they did and new lines are written into the arena.
+    template <typename Result = std::string, typename Lines>
+    static inline std::vector<Result> editedLines(Lines &original, const std::vector<SourceEdit> &edits, TextArena *arena = nullptr)
+    {
+        // Checked before anything is moved out of the original, so that it's left intact if the edits are wrong
+        for(int i = 0; i < (int)edits.size(); i++) {
+            const SourceEdit &edit = edits[i];
+            if(edit.line < 0 || edit.line >= (int)original.size() || edit.endLine >= (int)original.size()
+                    || edit.character < 0 || edit.character > (int)original[edit.line].size()
+                    || edit.endCharacter < 0 || edit.endCharacter > (int)original[edit.endLine].size()
+                    || edit.endLine < edit.line || (edit.endLine == edit.line && edit.endCharacter < edit.character))
+                throw(std::runtime_error("Edit outside the source"));
+            if(i > 0 && edits[i - 1].overlaps(edit)) throw(std::runtime_error("Overlapping edits"));
+        }
+        std::vector<Result> retval;
+        retval.reserve(original.size());
+        auto finish = [&] (std::string &line) {
+            if constexpr(std::is_same<Result, std::string>::value) retval.push_back(std::move(line));
+            else retval.push_back(arena->store(line));
+        };
+        std::string current;
+        int line = 0;
+        int character = 0;
+        auto copyUntil = [&] (int untilLine, int untilCharacter) {
+            for(; line < untilLine; line++, character = 0) {
+                // Whole lines that weren't touched aren't copied piece by piece
+                if(character == 0 && current.empty()) {
+                    if constexpr(ownsLines && !std::is_const<Lines>::value && std::is_same<Result, std::string>::value)
+                        retval.push_back(std::move(original[line]));
+                    else retval.emplace_back(original[line].data(), original[line].size());
+                    continue;
+                }
+                current.append(original[line].data() + character, original[line].size() - character);
+                finish(current);
+                current.clear();
+            }
+            if(line < (int)original.size()) {
+                current.append(original[line].data() + character, untilCharacter - character);
+                character = untilCharacter;
+            }
+        };
+        for(int i = 0; i < (int)edits.size(); i++) {
+            const SourceEdit &edit = edits[i];
+            copyUntil(edit.line, edit.character);
+            size_t written = 0;
+            for(size_t lineEnd = edit.replacement.find('\n'); lineEnd != std::string::npos; lineEnd = edit.replacement.find('\n', written)) {
+                current.append(edit.replacement, written, lineEnd - written);
+                finish(current);
+                current.clear();
+                written = lineEnd + 1;
+            }
+            current.append(edit.replacement, written, std::string::npos);
+            line = edit.endLine;
+            character = edit.endCharacter;
+        }
+        copyUntil(original.size(), 0);
+        return retval;
+    }
+    
+    // Differences between the files after cleanAll, line by line, with the line numbers of the original files.
+    // With more threads, the files are split at lines that are in each of them only once and the parts are compared in parallel.
+    static inline std::vector<DiffHunk> diff(const BasicSource &firstFile, const BasicSource &secondFile, int threads = 1)
+    {
+        std::vector<int> firstOriginal;
+        std::vector<int> secondOriginal;
+        BasicSource<std::string> first = cleanAll(firstFile, &firstOriginal);
+        BasicSource<std::string> second = cleanAll(secondFile, &secondOriginal);
+        std::vector<int> firstIds;
+        std::vector<int> secondIds;
+        lineIds(first.lines, second.lines, firstIds, secondIds);
+        std::vector<DiffHunk> retval = (threads > 1) ? Diff::compareParallel(firstIds, secondIds, threads) : Diff::compare(firstIds, secondIds);
+        auto toOriginal = [] (const std::vector<int> &original, int start, int end, int lineCount, int &originalStart, int &originalEnd) {
+            originalStart = (start < (int)original.size()) ? original[start] : lineCount;
+            originalEnd = (end > start) ? original[end - 1] + 1 : originalStart;
+        };
+        for(auto &hunk : retval) {
+            toOriginal(firstOriginal, hunk.firstStart, hunk.firstEnd, firstFile.lines.size(), hunk.firstStart, hunk.firstEnd);
+            toOriginal(secondOriginal, hunk.secondStart, hunk.secondEnd, secondFile.lines.size(), hunk.secondStart, hunk.secondEnd);
+        }
+        return retval;
+    }
+    
+    // Gives the same number to equal lines, so that they can be compared as numbers
+    template <typename FirstLine, typename SecondLine>
+    static inline void lineIds(const std::vector<FirstLine> &first, const std::vector<SecondLine> &second, std::vector<int> &firstIds, std::vector<int> &secondIds)
+    {
+        std::unordered_map<std::string_view, int> ids;
+        for(auto &line : first)
+            firstIds.push_back(ids.emplace(std::string_view(line), ids.size()).first->second);
+        for(auto &line : second)
+            secondIds.push_back(ids.emplace(std::string_view(line), ids.size()).first->second);
+    }
+    
+    // Counts the places where the files differ when written on one line, reporting them with differenceMaxSize characters around.
+    // Lines are compared first and only those that differ are compared character by character, both with Myers' algorithm.
+    static inline int mismatches(const BasicSource &firstFile, const BasicSource &secondFile, const int differenceMaxSize = 20, bool report = true)
+    {
+        EDITING_UTILS_PROFILE_SCOPE(Mismatches);
+        EDITING_UTILS_PROFILE_BYTES(firstFile.textSize() + secondFile.textSize());
+        int errors = 0;
+        std::vector<int> firstIds;
+        std::vector<int> secondIds;
+        lineIds(firstFile.lines, secondFile.lines, firstIds, secondIds);
+        for(const DiffHunk &lineHunk : Diff::compare(firstIds, secondIds)) {
+            // Views of the differing lines, copying them would cost as much as joining them
+            std::string first = BasicSource<std::string_view>(std::vector<std::string_view>(firstFile.lines.begin() + lineHunk.firstStart,
+                                                                                          firstFile.lines.begin() + lineHunk.firstEnd)).toString(true);
+            std::string second = BasicSource<std::string_view>(std::vector<std::string_view>(secondFile.lines.begin() + lineHunk.secondStart,
+                                                                                           secondFile.lines.begin() + lineHunk.secondEnd)).toString(true);
+            for(const DiffHunk &hunk : Diff::compare(first, second)) {
+                errors++;
+                EDITING_UTILS_PROFILE_MATCH();
+                if(report) {
+                    int firstContext = std::max(0, hunk.firstStart - differenceMaxSize);
+                    int secondContext = std::max(0, hunk.secondStart - differenceMaxSize);
+                    std::lock_guard<std::mutex> lock(reportMutex());
+                    std::cout << "Mismatch '" << first.substr(firstContext, hunk.firstEnd + differenceMaxSize - firstContext)
+                              << "' vs '" << second.substr(secondContext, hunk.secondEnd + differenceMaxSize - secondContext) << "'" << std::endl;
+                }
+            }
+        }
+        return errors;
+    }
+};
+
+using Source = BasicSource<std::string>;
+// Lines pointing into a mapped file or a shared text, for searching and comparing without copying them.
+// A view isn't turned into a Source on its first edit, applyEdits keeps the changed lines in editedText
+// and Source(view) has to be written to get lines that can be edited directly.
+using SourceView = BasicSource<std::string_view>;
+
+// Lines shared by copies until one of them edits them, so that forking a source to try a rewrite on it costs O(1)
+// and every fork keeps only the lines it changed. The lines are pieces of immutable blocks, the source it was made from
+// is the first block and every applyEdits adds a block with the lines it wrote.
+// Algorithms working on sources are used on view(), which keeps the lines alive.
+// Source itself isn't shared this way, its lines are edited directly, so copying a Source is still a deep copy.
+class SourceSnapshot {
+    typedef std::vector<std::string> Block;
+    struct Piece {
+        std::shared_ptr<const Block> block;
+        int first;
+        int count;
+    };
+    struct Table {
+        std::vector<Piece> pieces;
+        // The line where each piece starts
+        std::vector<int> starts;
+        int size = 0;
+        
+        inline int pieceOf(int line) const
+        {
+            return std::upper_bound(starts.begin(), starts.end(), line) - starts.begin() - 1;
+        }
+        
+        // Consecutive lines of the same block stay one piece, so that editing doesn't fragment untouched lines
+        inline void append(const std::shared_ptr<const Block> &block, int first, int count)
+        {
+            if(count == 0) return;
+            if(!pieces.empty() && pieces.back().block == block && pieces.back().first + pieces.back().count == first)
+                pieces.back().count += count;
+            else {
+                pieces.push_back(Piece{block, first, count});
+                starts.push_back(size);
+            }
+            size += count;
+        }
+        
+        inline void append(const Table &other, int first, int count)
+        {
+            for(int piece = count > 0 ? other.pieceOf(first) : 0; count > 0; piece++) {
+                const Piece &from = other.pieces[piece];
+                int offset = first - other.starts[piece];
+                int taken = std::min(count, from.count - offset);
+                append(from.block, from.first + offset, taken);
+                first += taken;
+                count -= taken;
+            }
+        }
+    };
+    std::shared_ptr<const Table> table;
+    
+public:
+    inline SourceSnapshot() : table(std::make_shared<Table>()) {}
+    // Pass the source with std::move to take over its lines instead of copying them
+    inline explicit SourceSnapshot(Source source)
+    {
+        int size = source.lines.size();
+        auto created = std::make_shared<Table>();
+        created->append(std::make_shared<const Block>(std::move(source.lines)), 0, size);
+        table = std::move(created);
+    }
+    
+    inline int size() const
+    {
+        return table->size;
+    }
+    
+    // O(log n) in the number of places edited
+    inline const std::string &line(int index) const
+    {
+        int piece = table->pieceOf(index);
+        return (*table->pieces[piece].block)[table->pieces[piece].first + index - table->starts[piece]];
+    }
+    
+    inline const std::string &operator[](int index) const
+    {
+        return line(index);
+    }
+    
+    // Same as Source::applyEdits, only the lines touched by the edits are copied and the copies of the snapshot
+    // keep sharing all the others. The snapshot is left unchanged if it throws.
+    inline void applyEdits(std::vector<SourceEdit> edits)
+    {
+        if(edits.empty()) return;
+        std::stable_sort(edits.begin(), edits.end());
+        auto written = std::make_shared<Block>();
+        auto created = std::make_shared<Table>();
+        int untouched = 0;
+        for(int i = 0; i < (int)edits.size();) {
+            // Edits sharing a line are applied together
+            int first = edits[i].line;
+            int last = first;
+            int end = i;
+            for(; end < (int)edits.size() && edits[end].line <= last; end++) {
+                if(edits[end].line < 0 || edits[end].endLine < edits[end].line || edits[end].endLine >= size())
+                    throw(std::runtime_error("Edit outside the source"));
+                last = std::max(last, edits[end].endLine);
+            }
+            std::vector<std::string> touched;
+            touched.reserve(last + 1 - first);
+            for(int line = first; line <= last; line++)
+                touched.push_back(this->line(line));
+            std::vector<SourceEdit> shifted(std::make_move_iterator(edits.begin() + i), std::make_move_iterator(edits.begin() + end));
+            for(SourceEdit &edit : shifted) {
+                edit.line -= first;
+                edit.endLine -= first;
+            }
+            std::vector<std::string> edited = Source::editedLines(touched, shifted);
+            created->append(*table, untouched, first - untouched);
+            created->append(written, written->size(), edited.size());
+            written->insert(written->end(), std::make_move_iterator(edited.begin()), std::make_move_iterator(edited.end()));
+            untouched = last + 1;
+            i = end;
+        }
+        created->append(*table, untouched, size() - untouched);
+        table = std::move(created);
+    }
+    
+    // The lines as views that keep the snapshot's lines alive even if it's edited or destroyed, O(n)
+    inline SourceView view() const
+    {
+        std::vector<std::string_view> lines;
+        lines.reserve(size());
+        for(const Piece &piece : table->pieces)
+            lines.insert(lines.end(), piece.block->begin() + piece.first, piece.block->begin() + piece.first + piece.count);
+        SourceView retval(std::move(lines));
+        retval.storage = table;
+        return retval;
+    }
+    
+    inline Source toSource() const
+    {
+        std::vector<std::string> lines;
+        lines.reserve(size());
+        for(const Piece &piece : table->pieces)
+            lines.insert(lines.end(), piece.block->begin() + piece.first, piece.block->begin() + piece.first + piece.count);
+        return Source(std::move(lines));
+    }
+};
+
+// Collects edits against the original positions of a source, recording or removing an edit costs O(log n)
+// no matter how many there are and they are all applied in a single pass at the end
+class EditBuffer {
+    std::multiset<SourceEdit> edits;
+public:
+    typedef std::multiset<SourceEdit>::const_iterator Handle;
+
+    inline Handle replace(int line, int character, int endLine, int endCharacter, std::string replacement)
+    {
+        return edits.emplace(line, character, endLine, endCharacter, std::move(replacement));
+    }
+
+    inline Handle insert(int line, int character, std::string inserted)
+    {
+        return replace(line, character, line, character, std::move(inserted));
+    }
+
+    inline Handle erase(int line, int character, int endLine, int endCharacter)
+    {
+        return replace(line, character, endLine, endCharacter, "");
+    }
+
+    // Takes back an edit that was recorded
+    inline void cancel(Handle edit)
+    {
+        edits.erase(edit);
+    }
+
+    inline size_t size() const
+    {
+        return edits.size();
+    }
 
-    std::vector<std::string> lines;
+    inline void clear()
+    {
+        edits.clear();
+    }
+
+    // Applies the edits to the source and forgets them
+    template <typename Line>
+    inline void applyTo(BasicSource<Line> &source)
+    {
+        source.applyEdits(std::vector<SourceEdit>(edits.begin(), edits.end()));
+        edits.clear();
+    }
+
+    inline void applyTo(SourceSnapshot &source)
+    {
+        source.applyEdits(std::vector<SourceEdit>(edits.begin(), edits.end()));
+        edits.clear();
+    }
+
+    inline Source appliedTo(const SourceView &source) const
+    {
+        return source.withEdits(std::vector<SourceEdit>(edits.begin(), edits.end()));
+    }
+};
+
+// The source split into tokens once, so that searches don't have to go through the characters again and again.
+// It must be told about changes of the lines through update() and only lexes the lines that changed again.
+// Tokens never span over lines, a comment or a string literal continued on the next line has a token on every line.
+class TokenIndex {
+public:
+    enum Kind : uint8_t { Identifier, Number, Punctuation, StringLiteral, CharLiteral, Comment };
+    // What the lexer is in at the start of a line
+    typedef Lexer::State State;
+    
+    struct Token {
+        int line;
+        int column;
+        int length;
+        Kind kind;
+        uint64_t hash; // Of the text, to look up identifiers without going to the source
+        
+        inline bool isCode() const
+        {
+            return kind != Comment;
+        }
+    };
+    
+    struct Match {
+        int first;
+        int last;
+    };
+    
+    std::vector<Token> tokens;
+    // Index of the first token of every line, with one more element at the end
+    std::vector<int> lineStarts;
+    std::vector<State> lineStates;
+    
+    template <typename Line>
+    inline explicit TokenIndex(const BasicSource<Line> &source)
+    {
+        lineStarts.push_back(0);
+        lineStates.push_back(State());
+        update(source, 0, 0, source.lines.size());
+    }
+    
+    // Lexes again the lines that replaced removedLines lines from firstLine on (and the following ones if their lexer state changed)
+    template <typename Line>
+    inline void update(const BasicSource<Line> &source, int firstLine, int removedLines, int insertedLines)
+    {
+        int oldLineCount = lineStates.size() - 1;
+        if(firstLine < 0 || removedLines < 0 || firstLine + removedLines > oldLineCount
+                || oldLineCount - removedLines + insertedLines != (int)source.lines.size())
+            throw(std::runtime_error("Token index updated with a wrong range of lines"));
+        std::vector<Token> lexed;
+        std::vector<int> starts;
+        std::vector<State> states;
+        State state = lineStates[firstLine];
+        int line = firstLine;
+        int oldLine = firstLine + removedLines;
+        // Lines after the changed ones are lexed too until the lexer arrives to them in the same state as before
+        while(line < firstLine + insertedLines || (oldLine < oldLineCount && state != lineStates[oldLine])) {
+            starts.push_back(lexed.size());
+            states.push_back(state);
+            state = lexLine(source.lines[line], line, state, lexed);
+            line++;
+            if(line > firstLine + insertedLines) oldLine++;
+        }
+        
+        int lineShift = insertedLines - removedLines;
+        int firstToken = lineStarts[firstLine];
+        int lastToken = lineStarts[oldLine];
+        int tokenShift = int(lexed.size()) - (lastToken - firstToken);
+        for(int i = lastToken; i < (int)tokens.size(); i++)
+            tokens[i].line += lineShift;
+        tokens.erase(tokens.begin() + firstToken, tokens.begin() + lastToken);
+        tokens.insert(tokens.begin() + firstToken, lexed.begin(), lexed.end());
+        
+        for(int &start : starts)
+            start += firstToken;
+        for(int i = oldLine; i < (int)lineStarts.size(); i++)
+            lineStarts[i] += tokenShift;
+        lineStarts.erase(lineStarts.begin() + firstLine, lineStarts.begin() + oldLine);
+        lineStarts.insert(lineStarts.begin() + firstLine, starts.begin(), starts.end());
+        lineStates.erase(lineStates.begin() + firstLine, lineStates.begin() + oldLine);
+        lineStates.insert(lineStates.begin() + firstLine, states.begin(), states.end());
+        if(oldLine == oldLineCount) lineStates.back() = state;
+        identifiers.valid = false;
+    }
+    
+    template <typename Line>
+    static inline std::string_view text(const BasicSource<Line> &source, const Token &token)
+    {
+        return std::string_view(source.lines[token.line]).substr(token.column, token.length);
+    }
+    
+    // Indexes of all tokens that are the identifier, found through a hash table
+    template <typename Line>
+    inline std::vector<int> findIdentifier(const BasicSource<Line> &source, std::string_view identifier) const
+    {
+        std::vector<int> retval;
+        const std::vector<int> *candidates = identifierTokens(hash(identifier));
+        if(candidates) {
+            for(int candidate : *candidates)
+                if(text(source, tokens[candidate]) == identifier)
+                    retval.push_back(candidate);
+        }
+        return retval;
+    }
+    
+    // Finds all places where the code has the same tokens as the expression, whitespace and comments between them are ignored
+    template <typename Line>
+    inline std::vector<Match> find(const BasicSource<Line> &source, const std::string &expression) const
+    {
+        if(expression.find('\n') != std::string::npos) throw(std::runtime_error("The sought expression must be on one line"));
+        std::vector<Token> sought;
+        lexLine(expression, 0, State(), sought);
+        std::vector<std::string_view> soughtTexts;
+        std::string_view expressionView(expression);
+        for(auto &token : sought) {
+            if(token.kind == Comment) throw(std::runtime_error("Comment in the sought expression"));
+            soughtTexts.push_back(expressionView.substr(token.column, token.length));
+        }
+        std::vector<Match> retval;
+        if(sought.empty()) return retval;
+        
+        auto matchAt = [&] (int first) {
+            int current = first;
+            for(int i = 0; i < (int)sought.size(); i++, current++) {
+                while(current < (int)tokens.size() && tokens[current].kind == Comment)
+                    current++;
+                // The kind is compared too, so that a part of a literal continued from the line before doesn't match code
+                if(current >= (int)tokens.size() || tokens[current].hash != sought[i].hash || tokens[current].kind != sought[i].kind
+                        || text(source, tokens[current]) != soughtTexts[i])
+                    return;
+            }
+            retval.push_back(Match{first, current - 1});
+        };
+        if(sought[0].kind == Identifier) {
+            const std::vector<int> *candidates = identifierTokens(sought[0].hash);
+            if(candidates) {
+                for(int candidate : *candidates)
+                    matchAt(candidate);
+            }
+        }
+        else {
+            for(int i = 0; i < (int)tokens.size(); i++)
+                if(tokens[i].hash == sought[0].hash)
+                    matchAt(i);
+        }
+        return retval;
+    }
+    
+    // Finds the token closing the bracket opened by the given token, comments and literals are skipped, -1 if not found
+    template <typename Line>
+    inline int findClosing(const BasicSource<Line> &source, int opening, char opener, char closer) const
+    {
+        int depth = 0;
+        for(int i = opening; i < (int)tokens.size(); i++) {
+            if(tokens[i].kind != Punctuation) continue;
+            char current = source.lines[tokens[i].line][tokens[i].column];
+            if(current == opener) depth++;
+            else if(current == closer) {
+                depth--;
+                if(depth == 0) return i;
+            }
+        }
+        return -1;
+    }
+    
+    static inline uint64_t hash(std::string_view text)
+    {
+        uint64_t retval = 14695981039346656037ull;
+        for(char character : text) {
+            retval ^= (unsigned char)character;
+            retval *= 1099511628211ull;
+        }
+        return retval;
+    }
+    
+    // Splits one line into tokens and returns the state the next line starts in, literals and comments are found by Lexer
+    template <typename Line>
+    static inline State lexLine(const Line &text, int line, State state, std::vector<Token> &output)
+    {
+        const char *data = text.data();
+        auto emit = [&] (int start, int end, Kind kind) {
+            std::string_view view(data + start, end - start);
+            output.push_back(Token{line, start, end - start, kind, hash(view)});
+        };
+        // A literal continued from the previous line starts at its beginning
+        int literalStart = state.inLiteral() ? 0 : -1;
+        Kind literalKind = (state.mode == Lexer::InCharacter || state.mode == Lexer::InCharacterEscape) ? CharLiteral : StringLiteral;
+        int literalEnd = 0;
+        auto finishLiteral = [&] {
+            if(literalStart >= 0 && literalEnd > literalStart) emit(literalStart, literalEnd, literalKind);
+            literalStart = -1;
+        };
+        Lexer::scanLine(text, state, [&] (int start, int end, Lexer::Kind kind) {
+            if(kind == Lexer::StringStart || kind == Lexer::CharacterStart) {
+                finishLiteral();
+                literalStart = start;
+                literalKind = (kind == Lexer::StringStart) ? StringLiteral : CharLiteral;
+            }
+            if(Lexer::isLiteral(kind)) {
+                literalEnd = end;
+                if(kind == Lexer::StringEnd || kind == Lexer::CharacterEnd) finishLiteral();
+                return true;
+            }
+            finishLiteral();
+            if(kind == Lexer::Comment) {
+                emit(start, end, Comment);
+                return true;
+            }
+            int i = start;
+            while(i < end) {
+                int tokenStart = i;
+                char current = data[i];
+                if(current == ' ' || current == '\t' || current == '\r' || current == '\f' || current == '\v') {
+                    i++;
+                }
+                else if(Source::isValidIdentifierChar(current)) {
+                    bool number = current >= '0' && current <= '9';
+                    // Digit separators like in 1'000'000 are a part of the number
+                    while(i < end && (Source::isValidIdentifierChar(data[i])
+                            || (number && data[i] == '\'' && i + 1 < end && Source::isValidIdentifierChar(data[i + 1]))))
+                        i++;
+                    emit(tokenStart, i, number ? Number : Identifier);
+                }
+                else {
+                    i++;
+                    emit(tokenStart, i, Punctuation);
+                }
+            }
+            return true;
+        });
+        finishLiteral();
+        return state;
+    }
+    
+private:
+    // Tokens of every identifier by its hash, built on the first search after a change. A copy builds its own.
+    struct Identifiers {
+        std::unordered_map<uint64_t, std::vector<int>> tokens;
+        std::atomic<bool> valid{false};
+        std::mutex mutex;
+        
+        inline Identifiers() = default;
+        inline Identifiers(const Identifiers &) {}
+        inline Identifiers &operator=(const Identifiers &)
+        {
+            valid = false;
+            return *this;
+        }
+    };
+    mutable Identifiers identifiers;
     
-    inline Source(const std::string &input)
+    // The table is built under a lock, so that searches can run in parallel (but not with update)
+    inline const std::vector<int> *identifierTokens(uint64_t hashed) const
     {
-        std::stringstream in(input);
-        std::string line;
-        while(std::getline(in, line)) {
-            lines.push_back(std::string());
-            lines.back().swap(line);
+        if(!identifiers.valid.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(identifiers.mutex);
+            if(!identifiers.valid.load(std::memory_order_relaxed)) {
+                identifiers.tokens.clear();
+                for(int i = 0; i < (int)tokens.size(); i++)
+                    if(tokens[i].kind == Identifier)
+                        identifiers.tokens[tokens[i].hash].push_back(i);
+                identifiers.valid.store(true, std::memory_order_release);
+            }
         }
+        auto found = identifiers.tokens.find(hashed);
+        return found == identifiers.tokens.end() ? nullptr : &found->second;
     }
-    inline Source(const std::vector<std::string> &lines) : lines(lines) {}
-    inline Source(const Source &) = default;
-    inline Source(Source &&) = default;
-    inline Source() = default;
-    inline Source operator=(const Source &other)
+};
+
+// Pairs of brackets in the source, so that the bracket closing any opening one is found in O(1).
+// It's built on the tokens, so brackets in literals and comments are skipped. Every kind of brackets
+// is paired separately like findEndOfList does it. Pairs of < and > are guessed, a < that isn't closed before
+// a semicolon, a brace, && or || or a closing bracket that encloses it is a comparison, << and -> are operators.
+// After the token index was updated, the table must be invalidated from the first changed line on;
+// pairs before it are kept and the rest is paired again on the next query.
+class BracketTable {
+    const TokenIndex &tokens;
+    // Partner of every token: -1 for brackets not closed till the end, -2 for tokens that aren't paired brackets
+    std::vector<int> partners;
+    // The innermost (, [ or { enclosing every token (the one before the token is processed)
+    std::vector<int> parents;
+    int validTokens = 0;
+    
+    static inline int bracketType(const TokenIndex::Token &token)
     {
-        lines = other.lines;
-        return *this;
+        static const std::array<uint64_t, 8> hashes = [] {
+            std::array<uint64_t, 8> retval;
+            const char *brackets = "([{<)]}>";
+            for(int i = 0; i < 8; i++)
+                retval[i] = TokenIndex::hash(std::string_view(brackets + i, 1));
+            return retval;
+        }();
+        if(token.kind != TokenIndex::Punctuation) return -1;
+        for(int i = 0; i < 8; i++)
+            if(token.hash == hashes[i]) return i;
+        return -1;
     }
     
-    static inline Source fromFile(const std::string &fileName)
+    static inline bool isPunctuation(const TokenIndex::Token &token, char character)
     {
-        std::ifstream input(fileName);
-        if(!input.good()) throw(std::runtime_error("File could not be opened"));
-        return Source::fromStream(input);
+        return token.kind == TokenIndex::Punctuation && token.hash == TokenIndex::hash(std::string_view(&character, 1));
     }
     
-    static inline Source fromStream(std::istream &input)
+    inline void ensureValid()
     {
-        std::vector<std::string> retval;
+        const std::vector<TokenIndex::Token> &all = tokens.tokens;
+        if(validTokens >= (int)all.size() && partners.size() == all.size()) return;
+        validTokens = std::min<int>(validTokens, all.size());
+        partners.resize(all.size(), -2);
+        parents.resize(all.size(), -1);
         
-        std::string line;
-        while(std::getline(input, line)) {
-            retval.push_back(std::string());
-            retval.back().swap(line);
+        // The brackets open at the first invalid token are the ones whose partner is after it, including < that were
+        // found to be comparisons only later (those have -3 minus the index of the token where it was found)
+        std::array<std::vector<int>, 4> open;
+        std::vector<int> enclosing;
+        for(int i = 0; i < validTokens; i++) {
+            int type = bracketType(all[i]);
+            if(type >= 0 && type < 4 && (partners[i] == -1 || partners[i] >= validTokens || (type == 3 && -3 - partners[i] >= validTokens))) {
+                partners[i] = -1;
+                open[type].push_back(i);
+            }
+        }
+        // The enclosing brackets are a chain of parents, starting with the innermost one after the last valid token
+        if(validTokens > 0) {
+            int last = validTokens - 1;
+            int type = bracketType(all[last]);
+            int innermost = parents[last];
+            if(type >= 0 && type < 3) innermost = last;
+            else if(type >= 4 && type < 7 && partners[last] >= 0) {
+                // The pair is removed from the chain only if it wasn't removed before by closing something enclosing it
+                int opening = partners[last];
+                int inChain = innermost;
+                while(inChain > opening)
+                    inChain = parents[inChain];
+                if(inChain == opening) innermost = parents[opening];
+            }
+            for(; innermost >= 0; innermost = parents[innermost])
+                enclosing.push_back(innermost);
+            std::reverse(enclosing.begin(), enclosing.end());
+        }
+        auto dropAngleBrackets = [&] (int after, int at) {
+            while(!open[3].empty() && open[3].back() > after) {
+                partners[open[3].back()] = -3 - at;
+                open[3].pop_back();
+            }
+        };
+        auto adjacent = [&] (int first, int second) {
+            return first >= 0 && second < (int)all.size() && all[first].line == all[second].line && all[first].column + 1 == all[second].column;
+        };
+        for(int i = validTokens; i < (int)all.size(); i++) {
+            partners[i] = -2;
+            parents[i] = enclosing.empty() ? -1 : enclosing.back();
+            int type = bracketType(all[i]);
+            if(type == 3) {
+                // << is an operator, not two brackets
+                if((adjacent(i, i + 1) && isPunctuation(all[i + 1], '<')) || (adjacent(i - 1, i) && isPunctuation(all[i - 1], '<')))
+                    continue;
+                open[3].push_back(i);
+                partners[i] = -1;
+            }
+            else if(type == 7) {
+                // -> and >= are operators
+                if((adjacent(i - 1, i) && isPunctuation(all[i - 1], '-')) || (adjacent(i, i + 1) && isPunctuation(all[i + 1], '=')))
+                    continue;
+                if(!open[3].empty()) {
+                    partners[i] = open[3].back();
+                    partners[open[3].back()] = i;
+                    open[3].pop_back();
+                }
+            }
+            else if(type >= 0 && type < 3) {
+                // An opening brace can't be inside a template argument list
+                if(type == 2) dropAngleBrackets(-1, i);
+                open[type].push_back(i);
+                enclosing.push_back(i);
+                partners[i] = -1;
+            }
+            else if(type >= 4) {
+                if(!open[type - 4].empty()) {
+                    int opening = open[type - 4].back();
+                    open[type - 4].pop_back();
+                    partners[i] = opening;
+                    partners[opening] = i;
+                    auto found = std::find(enclosing.rbegin(), enclosing.rend(), opening);
+                    if(found != enclosing.rend()) enclosing.erase(std::next(found).base(), enclosing.end());
+                    dropAngleBrackets(opening, i);
+                }
+            }
+            else if(isPunctuation(all[i], ';')) {
+                dropAngleBrackets(-1, i);
+            }
+            else if((isPunctuation(all[i], '&') || isPunctuation(all[i], '|')) && adjacent(i, i + 1) && all[i + 1].hash == all[i].hash) {
+                // && or || right inside a < can't be in a template argument list (unlike in void(T&&) inside one)
+                dropAngleBrackets(enclosing.empty() ? -1 : enclosing.back(), i);
+            }
         }
-        return Source(retval);
+        // Those never closed are comparisons too, it's marked as found after the last token
+        dropAngleBrackets(-1, all.size());
+        validTokens = all.size();
     }
     
-    void toStream(std::ostream &output, bool oneLine = false) const
+public:
+    inline BracketTable(const TokenIndex &tokens) : tokens(tokens)
     {
-        for(unsigned int i = 0; i < lines.size(); i++) {
-            output << lines[i];
-            if(i < lines.size() - 1) {
-                if(!oneLine) output << "\n";
-                else if(isValidIdentifierChar(lines[i][lines[i].size() - 1]) && isValidIdentifierChar(lines[i + 1].front()))
-                    output << " ";
-            }
-        }
+        ensureValid();
     }
     
-    void toFile(const std::string &fileName, bool oneLine = false) const
+    // Call after updating the token index, with the first line that was changed
+    inline void invalidate(int firstLine)
     {
-        std::ofstream output(fileName);
-        toStream(output, oneLine);
-        output.close();
-        std::cout << "Saved as " << fileName << std::endl;
+        int firstToken = (firstLine < (int)tokens.lineStarts.size()) ? tokens.lineStarts[firstLine] : tokens.tokens.size();
+        validTokens = std::min(validTokens, firstToken);
     }
     
-    std::string toString(bool oneLine = false) const
+    // Index of the token paired with the given token, -1 if it isn't closed, -2 if it's not a paired bracket
+    inline int partner(int token)
     {
-        std::string retval;
-        std::stringstream output(retval);
-        toStream(output, oneLine);
-        output.flush();
-        return output.str();
+        ensureValid();
+        return std::max(partners[token], -2);
     }
     
-    static inline bool isValidIdentifierChar(const char character)
+    // Index of the innermost (, [ or { enclosing the token, -1 if there is none, closing brackets are inside their pair
+    inline int enclosing(int token)
     {
-        if(character >= 'a' && character <= 'z') return true;
-        if(character >= 'A' && character <= 'Z') return true;
-        if(character >= '0' && character <= '9') return true;
-        if(character == '_' || character == '$') return true;
-        return false;
+        ensureValid();
+        int type = bracketType(tokens.tokens[token]);
+        if(type >= 4 && type < 7 && partners[token] >= 0) return partners[token];
+        return parents[token];
     }
     
-    inline int skipWhitespace(int line, int character) const
+    // Index of the first token that ends after the position, the token count if there's none
+    inline int tokenAt(int line, int character) const
     {
-        auto ln = lines[line];
-        if(ln[character] == ' ' || ln[character] == '\t' || ln[character] == '\r') {
-            if(character != 0 && (isValidIdentifierChar(ln[character - 1]) && isValidIdentifierChar(ln[character + 1]))) {
-                return character;
-            }
-            while(character < (int)ln.size() && (ln[character] == ' ' || ln[character] == '\t' || ln[character] == '\r'))
-                character++;
-            return character;
-        }
-        return character;
+        if(line >= (int)tokens.lineStarts.size() - 1) return tokens.tokens.size();
+        int first = tokens.lineStarts[line];
+        int last = tokens.lineStarts[line + 1];
+        return std::partition_point(tokens.tokens.begin() + first, tokens.tokens.begin() + last, [&] (const TokenIndex::Token &token) {
+            return token.column + token.length <= character;
+        }) - tokens.tokens.begin();
     }
     
-    inline int skipWhitespaceLines(int line) const
+    // Same as Source::findEndOfList for balanced brackets, but only looks into the table
+    inline void findEndOfList(int &line, int &character, char starting, char ending, int startingDepth = 0)
     {
-        while(line < (int)lines.size()) {
-            for(int i = 0; i < (int)lines[line].size(); i++) {
-                char ch = lines[line][i];
-                if(ch != ' ' && ch != '\t' && ch != '\r')
-                    return line;
+        ensureValid();
+        static const std::string openers = "([{<";
+        static const std::string closers = ")]}>";
+        size_t type = openers.find(starting);
+        if(type == std::string::npos || closers[type] != ending) throw(std::runtime_error("Unknown kind of brackets"));
+        int token = tokenAt(line, character);
+        int opening = -1;
+        if(startingDepth == 0) {
+            for(; token < (int)tokens.tokens.size() && opening < 0; token++) {
+                int found = bracketType(tokens.tokens[token]);
+                if(found == (int)type && partners[token] >= -1) opening = token;
+                else if(found == (int)type + 4 && partners[token] >= -1) break;
             }
-            line++;
         }
-        return lines.size() - 1;
+        else if(type < 3) {
+            // Walking up through the enclosing brackets of any kind, counting only the right ones
+            if(token < (int)tokens.tokens.size())
+                opening = enclosing(token);
+            while(opening >= 0) {
+                if(bracketType(tokens.tokens[opening]) == (int)type && --startingDepth == 0) break;
+                opening = parents[opening];
+            }
+        }
+        else {
+            // Going back over pairs of < and > to the unclosed ones
+            for(token--; token >= 0; token--) {
+                if(bracketType(tokens.tokens[token]) == 7 && partners[token] >= 0) token = partners[token];
+                else if(bracketType(tokens.tokens[token]) == 3 && partners[token] >= 0 && --startingDepth == 0) {
+                    opening = token;
+                    break;
+                }
+            }
+        }
+        if(opening < 0 || partners[opening] < 0) throw(std::runtime_error("End of list not found"));
+        const TokenIndex::Token &closing = tokens.tokens[partners[opening]];
+        line = closing.line;
+        character = closing.column;
     }
     
-    inline int findNextLineContaining(const std::string &sought, int line) const
+    template <typename Line>
+    inline std::string getTillEndOfList(const BasicSource<Line> &source, int line, int character, char starting, char ending, int startingDepth = 0)
     {
-        while(line < (int)lines.size() && lines[line].find(sought) == std::string::npos)
-            line++;
-        return line;
+        int endLine = line;
+        int endChar = character;
+        findEndOfList(endLine, endChar, starting, ending, startingDepth);
+        return source.getTillPosition(line, character, endLine, endChar);
     }
     
-    inline int goBackLine(int &line) const
+    template <typename Line>
+    inline std::string_view getTillEndOfList(TextArena &arena, const BasicSource<Line> &source, int line, int character, char starting, char ending,
+                                             int startingDepth = 0)
     {
-        line--;
-        if(line < 0) throw(std::runtime_error("Nothing interesting before the location"));
-        int found = lines[line].find("//");
-        if(found == std::string::npos) found = lines[line].size();
-        return found - 1;
+        int endLine = line;
+        int endChar = character;
+        findEndOfList(endLine, endChar, starting, ending, startingDepth);
+        return source.getTillPosition(arena, line, character, endLine, endChar);
     }
-    
-    // The function given receives line index, letter index of the occurrence and whether it's all on one line
-    // and must return the line index where it will restart its search on
-    // The expression sought after should have spaces only where necessary
-    // It is assumed that the new line number will not be set somewhere where it can match the result of edits
-    inline void iterateThroughOccurrences(const std::string &sought, std::function<int(int, int, bool)> callback) const
+};
+
+// A pattern with holes like make_shared<$T:list>($ARGS:list), found in the tokens of a source in a single pass.
+// The rest of the pattern is matched like in TokenIndex::find, whitespace and comments between the tokens are ignored.
+// A hole is $ with a name, optionally followed by a colon and its type: identifier (the default) is one identifier,
+// string is one or more string literals next to each other and list is any tokens with balanced brackets
+// up to the token that follows the hole in the pattern (found outside the brackets); < and > are counted as brackets
+// only in lists ended by >. The pattern is compiled into instructions, a thread running them is started at every token
+// the pattern can start at and all the threads advance together, token by token.
+class StructuralPattern {
+public:
+    enum HoleType : uint8_t { IdentifierHole, ListHole, StringHole };
+
+    // Tokens from the first one to the last one (last is first - 1 in an empty list) and where they start and end in the source
+    struct Span {
+        int first = 0;
+        int last = -1;
+        int line = 0;
+        int character = 0;
+        int endLine = 0;
+        int endCharacter = 0;
+    };
+
+    struct Match {
+        Span whole;
+        // In the order of holeNames
+        std::vector<Span> captures;
+    };
+
+    std::vector<std::string> holeNames;
+
+    inline explicit StructuralPattern(const std::string &pattern)
     {
-        bool stringLiteral = false;
-        for(int i = 0; i < (int)lines.size(); i++) {
-            for(int j = 0; j < (int)lines[i].size(); j++) {
-                if(lines[i][j] == '"' && (j == 0 || lines[i][j] != '\\'))
-                    stringLiteral = !stringLiteral;
-                if(lines[i][j] == sought[0]) {
-                    int line = i;
-                    int character = j;
-                    int passed = 0;
-                    bool oneLine = true;
-                    while(lines[line][character] == sought[passed]) {
-                        character++;
-                        passed++;
-                        if(!stringLiteral) character = skipWhitespace(line, character);
-                        if(character >= (int)lines[line].size() && !isValidIdentifierChar(sought[passed])) {
-                            oneLine = false;
-                            line++;
-                            if(line >= (int)lines.size()) return;
-                            if(!stringLiteral) character = skipWhitespace(line, 0);
-                        }
-                    }
-                    if(passed >= (int)sought.size()) {
-                        int newLine = callback(line, character, oneLine);
-                        if(line != newLine) {
-                            if(!stringLiteral) character = skipWhitespace(line, 0);
-                            line = newLine;
-                        }
-                    }
-                }
+        if(pattern.find('\n') != std::string::npos) throw(std::runtime_error("The pattern must be on one line"));
+        std::vector<TokenIndex::Token> tokens;
+        TokenIndex::lexLine(pattern, 0, TokenIndex::State(), tokens);
+        std::string_view patternView(pattern);
+        auto text = [&] (int token) {
+            return patternView.substr(tokens[token].column, tokens[token].length);
+        };
+        for(int i = 0; i < (int)tokens.size(); i++) {
+            if(tokens[i].kind == TokenIndex::Comment) throw(std::runtime_error("Comment in the pattern"));
+            Instruction instruction;
+            std::string_view current = text(i);
+            if(tokens[i].kind != TokenIndex::Identifier || current.size() < 2 || current[0] != '$') {
+                instruction.kind = tokens[i].kind;
+                instruction.hash = tokens[i].hash;
+                instruction.text = current;
+                program.push_back(instruction);
+                continue;
             }
-        }
-    }
-    
-    // When at some spot where something is written, this will find the variable the element is assigned to
-    // or throws exception on failure
-    inline std::string whatIsItAssignedTo(int line, int character) const
-    {
-        while(lines[line][character] != '=') {
-            character--;
-            if(character < 0) {
-                character = goBackLine(line);
+            instruction.operation = Instruction::Hole;
+            std::string name(current.substr(1));
+            if(std::find(holeNames.begin(), holeNames.end(), name) != holeNames.end()) throw(std::runtime_error("Hole " + name + " is in the pattern twice"));
+            instruction.capture = holeNames.size();
+            holeNames.push_back(name);
+            if(i + 2 < (int)tokens.size() && text(i + 1) == ":" && tokens[i + 2].kind == TokenIndex::Identifier) {
+                std::string_view type = text(i + 2);
+                if(type == "identifier") instruction.type = IdentifierHole;
+                else if(type == "list") instruction.type = ListHole;
+                else if(type == "string") instruction.type = StringHole;
+                else throw(std::runtime_error("Unknown type of hole " + name + ": " + std::string(type)));
+                i += 2;
             }
+            program.push_back(instruction);
         }
-        while(!isValidIdentifierChar(lines[line][character])) {
-            character--;
-            if(character < 0) {
-                character = goBackLine(line);
+        if(program.empty()) throw(std::runtime_error("Empty pattern"));
+        if(program[0].operation == Instruction::Hole && program[0].type == ListHole) throw(std::runtime_error("The pattern can't start with a list"));
+        for(int i = 0; i < (int)program.size(); i++) {
+            Instruction &instruction = program[i];
+            if(instruction.operation != Instruction::Hole) continue;
+            bool literalAfter = i + 1 < (int)program.size() && program[i + 1].operation == Instruction::Literal;
+            if(instruction.type == ListHole) {
+                if(!literalAfter) throw(std::runtime_error("A list must be followed by a token in the pattern"));
+                instruction.angles = program[i + 1].text == ">";
             }
-            if(lines[line][character] == ';') throw(std::runtime_error("Semicolon ; before assignment (can possibly be in a lambda)"));
+            // A string followed by another one couldn't be told apart from one string
+            if(instruction.type == StringHole && i + 1 < (int)program.size()
+                    && (program[i + 1].operation == Instruction::Hole ? program[i + 1].type == StringHole : program[i + 1].kind == TokenIndex::StringLiteral))
+                throw(std::runtime_error("A string can't be followed by a string in the pattern"));
         }
-        int end = character;
-        std::string variable;
-        while(character > 0 && isValidIdentifierChar(lines[line][character])) {
-            character--;
-        }
-        return lines[line].substr(character + 1, end - character);
     }
-    
-    inline std::vector<std::string> parseList(int line, int character, char separator, char ender, char opener = 0) const
+
+    // The index of the capture of the hole with the given name
+    inline int hole(std::string_view name) const
     {
-        int depth = 0;
-        std::vector<std::string> retval{""};
-        bool stringLiteral = false;
-        while(depth >= 0) {
-            char current = lines[line][character];
-            if(!stringLiteral && current == opener) {
-                depth++;
-                retval.back().push_back(opener);
-            }
-            else if(!stringLiteral && current == ender) {
-                if(depth > 0) retval.back().push_back(ender);
-                depth--;
-            }
-            else if(current == '"' && (character == 0 || lines[line][character - 1] != '\\')) {
-                stringLiteral = !stringLiteral;
-                retval.back().push_back(current);
-            }
-            else if(!stringLiteral && retval.back().size() == 0 && (current == ' ' || current == '\t' || current == '\r')) {}
-            else if(!stringLiteral && depth == 0 && current == separator) {
-                retval.push_back("");
+        auto found = std::find(holeNames.begin(), holeNames.end(), name);
+        if(found == holeNames.end()) throw(std::runtime_error("No hole " + std::string(name) + " in the pattern"));
+        return found - holeNames.begin();
+    }
+
+    // All the matches ordered by where they start, nested ones are found too
+    template <typename Line>
+    inline std::vector<Match> find(const BasicSource<Line> &source, const TokenIndex &index) const
+    {
+        const std::vector<TokenIndex::Token> &tokens = index.tokens;
+        int stride = holeNames.size() * 2;
+        // Captured tokens of all threads, a slot of two numbers for each hole, the slots of finished threads are reused
+        std::vector<int> captured;
+        std::vector<int> freeSlots;
+        std::vector<Thread> threads;
+        std::vector<Thread> advanced;
+        std::vector<Match> retval;
+        auto span = [&] (int first, int last) {
+            Span retval;
+            retval.first = first;
+            retval.last = last;
+            const TokenIndex::Token &start = tokens[std::min<int>(first, tokens.size() - 1)];
+            const TokenIndex::Token &end = (last >= first) ? tokens[last] : start;
+            retval.line = start.line;
+            retval.character = (first < (int)tokens.size()) ? start.column : start.column + start.length;
+            retval.endLine = end.line;
+            retval.endCharacter = (last >= first) ? end.column + end.length : retval.character;
+            return retval;
+        };
+        auto finish = [&] (const Thread &thread) {
+            Match match;
+            match.whole = span(thread.first, thread.last);
+            for(int i = 0; i < (int)holeNames.size(); i++)
+                match.captures.push_back(span(captured[thread.slot + i * 2], captured[thread.slot + i * 2 + 1]));
+            retval.push_back(std::move(match));
+        };
+        auto literalMatches = [&] (const Instruction &instruction, const TokenIndex::Token &token) {
+            return token.hash == instruction.hash && token.kind == instruction.kind && TokenIndex::text(source, token) == instruction.text;
+        };
+        auto punctuation = [&] (const TokenIndex::Token &token) {
+            return (token.kind == TokenIndex::Punctuation) ? source.lines[token.line][token.column] : '\0';
+        };
+        // Runs the thread on the token (the one after the last one if it's the end), returns whether it continues
+        auto step = [&] (Thread &thread, int token) {
+            bool end = token >= (int)tokens.size();
+            while(true) {
+                if(thread.instruction == (int)program.size()) {
+                    finish(thread);
+                    return false;
+                }
+                const Instruction &instruction = program[thread.instruction];
+                int *capture = captured.data() + thread.slot + instruction.capture * 2;
+                if(instruction.operation == Instruction::Literal) {
+                    if(end || !literalMatches(instruction, tokens[token])) return false;
+                }
+                else if(instruction.type == IdentifierHole) {
+                    if(end || tokens[token].kind != TokenIndex::Identifier) return false;
+                    capture[0] = token;
+                    capture[1] = token;
+                }
+                else if(instruction.type == StringHole) {
+                    bool started = capture[1] >= capture[0];
+                    if(!end && tokens[token].kind == TokenIndex::StringLiteral) {
+                        if(!started) capture[0] = token;
+                        capture[1] = token;
+                        thread.last = token;
+                        return true;
+                    }
+                    if(!started) return false;
+                    thread.instruction++;
+                    continue;
+                }
+                else {
+                    if(end) return false;
+                    bool started = capture[1] >= capture[0];
+                    if(thread.depth == 0 && literalMatches(program[thread.instruction + 1], tokens[token])) {
+                        if(!started) {
+                            capture[0] = token;
+                            capture[1] = token - 1;
+                        }
+                        thread.instruction++;
+                        continue;
+                    }
+                    char current = punctuation(tokens[token]);
+                    if(current == '(' || current == '[' || current == '{' || (instruction.angles && current == '<')) thread.depth++;
+                    else if(current == ')' || current == ']' || current == '}' || (instruction.angles && current == '>')) thread.depth--;
+                    // The list can't leave the brackets it's in or the statement
+                    if(thread.depth < 0 || (thread.depth == 0 && current == ';')) return false;
+                    if(!started) capture[0] = token;
+                    capture[1] = token;
+                    thread.last = token;
+                    return true;
+                }
+                thread.last = token;
+                thread.instruction++;
+                if(thread.instruction == (int)program.size()) {
+                    finish(thread);
+                    return false;
+                }
+                return true;
             }
-            else {
-                retval.back().push_back(current);
+        };
+        auto release = [&] (const Thread &thread) {
+            freeSlots.push_back(thread.slot);
+        };
+        const Instruction &first = program[0];
+        for(int token = 0; token <= (int)tokens.size(); token++) {
+            bool end = token == (int)tokens.size();
+            if(!end && !tokens[token].isCode()) continue;
+            advanced.clear();
+            for(Thread &thread : threads) {
+                if(step(thread, token)) advanced.push_back(thread);
+                else release(thread);
             }
-            character++;
-            if(character >= (int)lines[line].size()) {
-                line++;
-                if(line >= (int)lines.size()) return retval;
-                if(!stringLiteral) character = skipWhitespace(line, 0);
+            bool canStart = !end && ((first.operation == Instruction::Literal) ? literalMatches(first, tokens[token])
+                    : tokens[token].kind == ((first.type == StringHole) ? TokenIndex::StringLiteral : TokenIndex::Identifier));
+            if(canStart) {
+                Thread thread;
+                thread.first = token;
+                if(freeSlots.empty()) {
+                    thread.slot = captured.size();
+                    captured.resize(captured.size() + stride);
+                }
                 else {
-                    character = 0;
-                    retval.back().push_back('\n');
+                    thread.slot = freeSlots.back();
+                    freeSlots.pop_back();
                 }
+                // Nothing captured yet, as an empty span at the end of the source
+                for(int i = 0; i < stride; i += 2) {
+                    captured[thread.slot + i] = tokens.size();
+                    captured[thread.slot + i + 1] = int(tokens.size()) - 1;
+                }
+                if(step(thread, token)) advanced.push_back(thread);
+                else release(thread);
             }
+            std::swap(threads, advanced);
         }
+        std::stable_sort(retval.begin(), retval.end(), [] (const Match &first, const Match &second) {
+            return first.whole.first < second.whole.first;
+        });
         return retval;
     }
-    
-    static inline std::string getStringLiteral(const std::string &source)
+
+    template <typename Line>
+    inline std::vector<Match> find(const BasicSource<Line> &source) const
     {
-        std::string retval;
-        int index = 0;
-        bool stringLiteral = false;
-        while(index < (int)source.size()) {
-            if(source[index] == '"' && (index == 0 || source[index - 1] != '\\'))
-                stringLiteral = !stringLiteral;
-            else if(stringLiteral)
-                retval.push_back(source[index]);
-            index++;
+        TokenIndex index(source);
+        return find(source, index);
+    }
+
+    // The text of the source in the span, with the line breaks in it
+    template <typename Line>
+    static inline std::string text(const BasicSource<Line> &source, const Span &span)
+    {
+        if(span.line == span.endLine) return std::string(std::string_view(source.lines[span.line]).substr(span.character, span.endCharacter - span.character));
+        std::string retval(std::string_view(source.lines[span.line]).substr(span.character));
+        for(int i = span.line + 1; i < span.endLine; i++) {
+            retval.push_back('\n');
+            retval.append(source.lines[i]);
         }
+        retval.push_back('\n');
+        retval.append(std::string_view(source.lines[span.endLine]).substr(0, span.endCharacter));
         return retval;
     }
+
+private:
+    struct Instruction {
+        enum Operation : uint8_t { Literal, Hole };
+        Operation operation = Literal;
+        HoleType type = IdentifierHole;
+        // Lists ended by > count < and > as brackets
+        bool angles = false;
+        int capture = 0;
+        TokenIndex::Kind kind = TokenIndex::Punctuation;
+        uint64_t hash = 0;
+        std::string text;
+    };
+
+    struct Thread {
+        int instruction = 0;
+        int first = 0;
+        int last = -1;
+        // Of the brackets in the list being matched
+        int depth = 0;
+        int slot = 0;
+    };
+
+    std::vector<Instruction> program;
+};
+
+// Does the same as cleanAll followed by toString(true), but on a stream of text given in chunks of any size,
+// so that files of any size can be normalised with memory use bounded by the chunk size.
+// The normalised text is given to the sink in pieces.
+class StreamingNormaliser {
+public:
+    typedef std::function<void(std::string_view)> Sink;
     
-    void findEndOfList(int &line, int &character, char starting, char ending, int startingDepth = 0) const
+private:
+    Sink sink;
+    std::string output;
+    size_t outputLimit;
+    char lastOutput = '\0';
+    
+    // Comments are removed by the lexer, as cleanAll does it
+    Lexer::State lexer;
+    
+    // Normalising the line without comments, as normaliseLine does it; a character is normalised when the next one is known
+    bool hasPending = false;
+    char pending = '\0';
+    bool pendingInLiteral = false;
+    char beforePending = '\0';
+    bool pendingAtStart = false;
+    bool lineHasOutput = false;
+    
+    inline void emit(char character)
     {
-        int depth = startingDepth;
-        for(; line < (int)lines.size(); line++) {
-            for(; character < (int)lines[line].size(); character++) {
-                char current = lines[line][character];
-                if(current == starting) {
-                    depth++;
-                }
-                else if(current == ending) {
-                    depth--;
-                    if(depth == 0) return;
-                }
-                //else if(current == ';') throw(std::runtime_error("Semicolon ; found before end of list"));
-            }
-            character = 0;
+        // Lines are joined with a space only if it would join identifiers otherwise
+        if(!lineHasOutput) {
+            lineHasOutput = true;
+            if(Source::isValidIdentifierChar(lastOutput) && Source::isValidIdentifierChar(character))
+                output.push_back(' ');
         }
-        throw(std::runtime_error("End of list not found"));
+        output.push_back(character);
+        lastOutput = character;
+        if(output.size() >= outputLimit) flush();
     }
     
-    std::string getTillEndOfList(int line, int character, char starting, char ending, int startingDepth = 0) const
+    inline void normaliseCharacter(char character, bool inLiteral, char previous, bool atStart, char next)
     {
-        int endLine = line;
-        int endChar = character;
-        findEndOfList(endLine, endChar, starting, ending, startingDepth);
-        std::string retval = (line == endLine) ? lines[line].substr(character, endChar - character) : lines[line].substr(character);
-        for(int k = 1; k < endLine - line + 1; k++) {
-            int startAt = skipWhitespace(line + k, 0);
-            if(k < endLine - line - 2)
-                retval.append(lines[line + k].substr(startAt));
-            else
-                retval.append(lines[line + k].substr(startAt, endChar - startAt));
+        if(character == '\r')
+            return;
+        else if(character != ' ' && character != '\t')
+            emit(character);
+        else if(inLiteral || (!atStart && Source::isValidIdentifierChar(previous) && Source::isValidIdentifierChar(next)))
+            emit(' ');
+    }
+    
+    inline void normalise(char character, bool inLiteral)
+    {
+        if(hasPending) {
+            normaliseCharacter(pending, pendingInLiteral, beforePending, pendingAtStart, character);
+            beforePending = pending;
+            pendingAtStart = false;
         }
-        return retval;
+        else {
+            beforePending = '\0';
+            pendingAtStart = true;
+        }
+        pending = character;
+        pendingInLiteral = inLiteral;
+        hasPending = true;
     }
     
-    static inline std::string removeConst(const std::string &from)
+    inline void endLine()
     {
-        std::string retval;
-        const char *reading = from.c_str();
-        while(*reading) {
-            if(*reading == 'c' && *(reading + 1) == 'o' && *(reading + 2) == 'n' && *(reading + 3) == 's'
-                    && *(reading + 4) == 't' && (*(reading + 5) == ' ' || *(reading + 5) == '\t'))
-                reading += 6;
-            else {
-                retval.push_back(*reading);
-                reading++;
+        if(hasPending) normaliseCharacter(pending, pendingInLiteral, beforePending, pendingAtStart, '\0');
+        hasPending = false;
+        lineHasOutput = false;
+    }
+    
+    // A run of characters from the lexer, the one starting at -1 is a slash from the end of the previous chunk
+    inline bool consume(const char *data, int start, int end, Lexer::Kind kind)
+    {
+        if(start < 0) {
+            if(kind != Lexer::Comment) normalise('/', false);
+            start = 0;
+        }
+        for(int i = start; i < end; i++) {
+            if(kind == Lexer::Comment) {
+                // Only line breaks matter in comments
+                const void *found = std::memchr(data + i, '\n', end - i);
+                if(!found) break;
+                i = static_cast<const char*>(found) - data;
             }
+            if(data[i] == '\n') endLine();
+            else normalise(data[i], Lexer::isLiteral(kind));
         }
-        return retval;
+        return true;
     }
     
-    static inline std::string removeReference(const std::string &from)
+public:
+    inline StreamingNormaliser(Sink sink, size_t outputLimit = 1 << 16) : sink(std::move(sink)), outputLimit(outputLimit)
     {
-        std::string retval;
-        const char *reading = from.c_str();
-        while(*reading) {
-            if(*reading == '&') {}
-            else if(*reading == ' ' && *(reading + 1) == '&') {}
-            else
-                retval.push_back(*reading);
-            reading++;
+        output.reserve(outputLimit);
+    }
+    
+    inline void feed(std::string_view chunk)
+    {
+        Lexer::scan(chunk.data(), chunk.size(), lexer, [&] (int start, int end, Lexer::Kind kind) {
+            return consume(chunk.data(), start, end, kind);
+        });
+    }
+    
+    // Gives the sink what was normalised so far, everything that can be normalised without seeing the rest
+    inline void flush()
+    {
+        if(!output.empty()) sink(output);
+        output.clear();
+    }
+    
+    inline void finish()
+    {
+        Lexer::scanLine(nullptr, 0, lexer, [&] (int start, int end, Lexer::Kind kind) {
+            return consume(nullptr, start, end, kind);
+        });
+        endLine();
+        flush();
+    }
+    
+    static inline void normaliseStream(std::istream &input, Sink sink, size_t chunkSize = 1 << 16)
+    {
+        StreamingNormaliser normaliser(std::move(sink), chunkSize);
+        std::vector<char> chunk(chunkSize);
+        while(input) {
+            input.read(chunk.data(), chunk.size());
+            normaliser.feed(std::string_view(chunk.data(), input.gcount()));
         }
-        return retval;
+        normaliser.finish();
     }
     
-    static inline std::string normaliseLine(const std::string &input)
+    // The file is mapped, not read, so only the normalised output is buffered
+    static inline void normaliseFile(const std::string &fileName, Sink sink, size_t chunkSize = 1 << 16)
+    {
+        MappedFile file(fileName);
+        StreamingNormaliser normaliser(std::move(sink), chunkSize);
+        for(size_t done = 0; done < file.size(); done += chunkSize)
+            normaliser.feed(file.view().substr(done, chunkSize));
+        normaliser.finish();
+    }
+    
+    static inline std::string normalise(std::string_view text)
     {
         std::string retval;
-        bool literalActive = false;
-        for(int i = 0; i < (int)input.size(); i++) {
-            if(input[i] == '"' && (i == 0 || input[i - 1] != '\\')) {
-                literalActive = !literalActive;
-            }
-            if(input[i] == '/' && input[i + 1] == '/')
-                break;
-            else if(input[i] == '\r')
-                continue;
-            else if(input[i] != ' ' && input[i] != '\t')
-                retval.push_back(input[i]);
-            else if(literalActive || (i > 0 && isValidIdentifierChar(input[i - 1]) && isValidIdentifierChar(input[i + 1])))
-                retval.push_back(' ');
-        }
+        StreamingNormaliser normaliser([&] (std::string_view piece) { retval.append(piece); });
+        normaliser.feed(text);
+        normaliser.finish();
         return retval;
     }
-    
-    static inline Source cleanAll(const Source &input)
+};
+
+// Compares two streams after normalising them without loading either of them whole
+class StreamingComparator {
+public:
+    // The position in the normalised text where they start to differ, -1 if they are the same
+    static inline long long firstDifference(std::istream &first, std::istream &second, size_t chunkSize = 1 << 16)
     {
-        std::vector<std::string> retval;
-        bool commentActive = false;
-        for(int i = 0; i < (int)input.lines.size(); i++) {
-            std::string line;
-            bool literalActive = false;
-            for(int j = 0; j < (int)input.lines[i].size(); j++) {
-                char character = input.lines[i][j];
-                if(character == '"' && (j == 0 || input.lines[i][j - 1] != '\\')) {
-                    literalActive = !literalActive;
-                }
-                else if(character == '/') {
-                    if(input.lines[i][j + 1] == '*') {
-                        commentActive = true;
-                        j++;
-                        continue;
-                    }
-                    else if(j > 0 && input.lines[i][j - 1] == '*') {
-                        commentActive = false;
-                        continue;
-                    }
-                }
-                if(!commentActive) {
-                    line.push_back(character);
-                }
-            }
-            line = normaliseLine(line);
-            if(!line.empty()) {
-                retval.push_back(line);
+        std::string firstPending;
+        std::string secondPending;
+        StreamingNormaliser firstNormaliser([&] (std::string_view piece) { firstPending.append(piece); }, chunkSize);
+        StreamingNormaliser secondNormaliser([&] (std::string_view piece) { secondPending.append(piece); }, chunkSize);
+        std::vector<char> chunk(chunkSize);
+        long long compared = 0;
+        bool firstEnded = false;
+        bool secondEnded = false;
+        auto readMore = [&] (std::istream &input, StreamingNormaliser &normaliser, bool &ended) {
+            input.read(chunk.data(), chunk.size());
+            normaliser.feed(std::string_view(chunk.data(), input.gcount()));
+            if(!input) {
+                normaliser.finish();
+                ended = true;
             }
+            else normaliser.flush();
+        };
+        while(true) {
+            // Reading from the one that is behind keeps both buffers small
+            if(!firstEnded && (firstPending.size() <= secondPending.size() || secondEnded)) readMore(first, firstNormaliser, firstEnded);
+            else if(!secondEnded) readMore(second, secondNormaliser, secondEnded);
+            size_t common = std::min(firstPending.size(), secondPending.size());
+            auto mismatch = std::mismatch(firstPending.begin(), firstPending.begin() + common, secondPending.begin());
+            if(mismatch.first != firstPending.begin() + common) return compared + (mismatch.first - firstPending.begin());
+            compared += common;
+            firstPending.erase(0, common);
+            secondPending.erase(0, common);
+            if(firstEnded && secondEnded) return (firstPending.empty() && secondPending.empty()) ? -1 : compared;
         }
-        return Source(retval);
     }
     
-    static inline int mismatches(const Source &firstFile, const Source &secondFile, const int differenceMaxSize = 20, bool report = true)
+    static inline long long firstDifference(const std::string &firstFile, const std::string &secondFile, size_t chunkSize = 1 << 16)
     {
-        int errors = 0;
-        std::string first = firstFile.toString(true);
-        std::string second = secondFile.toString(true);
-        
-        int i1 = 0;
-        int i2 = 0;
-        for(; i1 < (int)first.size() && i2 < (int)second.size(); i1++, i2++) {
-            if(first[i1] != second[i2]) {
-                std::pair<int, int> firstRange(std::max(0, i1 - differenceMaxSize), std::min<int>(first.size() - 1, i1 + differenceMaxSize));
-                std::pair<int, int> secondRange(std::max(0, i2 - differenceMaxSize), std::min<int>(second.size() - 1, i2 + differenceMaxSize));
-                errors++;
-                if(report)
-                    std::cout << "Mismatch '" << first.substr(firstRange.first, firstRange.second - firstRange.first)
-                              << "' vs '" << second.substr(secondRange.first, secondRange.second - secondRange.first) << "'" << std::endl;
-                              
-                bool found = false;
-                for(int i = 0; i < differenceMaxSize; i++) {
-                    bool match = true;
-                    for(int j = 0; j < differenceMaxSize && i + j + i1 < (int)first.size() && j + i2 < (int)second.size(); j++)
-                        if(first[i1 + j + i] != second[i2 + j]) {
-                            match = false;
-                            break;
-                        }
-                    if(match == true) {
-                        i1 += i; // Found how to transpose i1 ahead
-                        found = true;
-                    }
-                }
-                if(!found)
-                    for(int i = 0; i < differenceMaxSize; i++) {
-                        bool match = true;
-                        for(int j = 0; j < differenceMaxSize && i + j + i2 < (int)second.size() && j + i1 < (int)first.size(); j++)
-                            if(second[i2 + j + i] != first[i1 + j]) {
-                                match = false;
-                                break;
-                            }
-                        if(match == true) {
-                            i2 += i; // Found how to transpose i2 ahead
-                            found = true;
-                        }
-                    }
-                if(!found && report) {
-                    std::cout << "Could not catch up, difference might be too large" << std::endl;
-                    return errors;
-                }
-            }
-        }
-        
-        return errors;
+        std::ifstream first(firstFile, std::ios::binary);
+        std::ifstream second(secondFile, std::ios::binary);
+        if(!first.good() || !second.good()) throw(std::runtime_error("File could not be opened"));
+        return firstDifference(first, second, chunkSize);
     }
-};
\ No newline at end of file
+};
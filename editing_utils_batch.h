@@ -0,0 +1,1049 @@
+#pragma once
+
+#include "editing_utils.h"
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <iomanip>
+#include <unordered_set>
+
+// Writes into a new file next to the target and renames it over the target, so that an interrupted write never leaves
+// a half written file behind. Every write has its own temporary file, so concurrent writes of the same file don't mix,
+// and the target keeps its permissions (a new file gets the default ones).
+inline void writeFileAtomically(const std::string &fileName, std::string_view contents)
+{
+    static std::atomic<unsigned int> writes{0};
+#if defined(__unix__) || defined(__APPLE__)
+    struct stat status;
+    bool existed = stat(fileName.c_str(), &status) == 0;
+    std::string temporary;
+    int descriptor = -1;
+    while(descriptor < 0) {
+        temporary = fileName + ".editing_tmp." + std::to_string(getpid()) + "." + std::to_string(writes++);
+        descriptor = open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+        if(descriptor < 0 && errno != EEXIST) throw(std::runtime_error("File could not be created"));
+    }
+    bool written = (!existed || fchmod(descriptor, status.st_mode & 07777) == 0) && writeAll(descriptor, contents);
+    if(close(descriptor) < 0) written = false;
+    if(!written || rename(temporary.c_str(), fileName.c_str()) < 0) {
+        unlink(temporary.c_str());
+        throw(std::runtime_error("File could not be written"));
+    }
+#else
+    std::string temporary = fileName + ".editing_tmp." + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count())
+            + "." + std::to_string(writes++);
+    try {
+        writeFile(temporary, contents);
+        std::error_code error;
+        std::filesystem::perms permissions = std::filesystem::status(fileName, error).permissions();
+        if(!error) std::filesystem::permissions(temporary, permissions);
+        std::filesystem::rename(temporary, fileName);
+    }
+    catch(std::exception &) {
+        std::remove(temporary.c_str());
+        throw;
+    }
+#endif
+}
+
+// Every thread has its own queue of tasks and takes work from the others' queues when it runs out,
+// so a few huge files don't leave the other threads idle
+class ThreadPool {
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex stateMutex;
+    std::condition_variable wakeUp;
+    std::condition_variable finished;
+    int queued = 0;
+    int unfinished = 0;
+    bool stopping = false;
+    std::exception_ptr failure;
+    std::atomic<unsigned int> nextQueue{0};
+
+    inline bool takeTask(int worker, std::function<void()> &task)
+    {
+        {
+            Queue &own = *queues[worker];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if(!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for(int i = 1; i < (int)queues.size(); i++) {
+            Queue &other = *queues[(worker + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(other.mutex);
+            if(!other.tasks.empty()) {
+                task = std::move(other.tasks.front());
+                other.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    inline void work(int worker)
+    {
+        while(true) {
+            {
+                std::unique_lock<std::mutex> lock(stateMutex);
+                wakeUp.wait(lock, [&] { return stopping || queued > 0; });
+                if(queued == 0) return;
+                queued--;
+            }
+            std::function<void()> task;
+            // The task counted above is guaranteed to be in some queue, but maybe not found on the first sweep
+            while(!takeTask(worker, task)) std::this_thread::yield();
+            try {
+                task();
+            }
+            catch(...) {
+                std::lock_guard<std::mutex> lock(stateMutex);
+                if(!failure) failure = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(stateMutex);
+            unfinished--;
+            if(unfinished == 0) finished.notify_all();
+        }
+    }
+
+public:
+    // Zero threads means as many as the hardware can run at once
+    inline ThreadPool(int threads = 0)
+    {
+        if(threads <= 0) threads = std::max<int>(1, std::thread::hardware_concurrency());
+        for(int i = 0; i < threads; i++)
+            queues.emplace_back(new Queue());
+        for(int i = 0; i < threads; i++)
+            workers.emplace_back([this, i] { work(i); });
+    }
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+    inline ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for(auto &worker : workers)
+            worker.join();
+    }
+
+    inline int threads() const
+    {
+        return workers.size();
+    }
+
+    inline void submit(std::function<void()> task)
+    {
+        Queue &queue = *queues[nextQueue++ % queues.size()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            queued++;
+            unfinished++;
+        }
+        wakeUp.notify_one();
+    }
+
+    // Blocks until all submitted tasks are done, rethrows the first exception a task has thrown
+    inline void wait()
+    {
+        std::unique_lock<std::mutex> lock(stateMutex);
+        finished.wait(lock, [&] { return unfinished == 0; });
+        if(failure) {
+            std::exception_ptr thrown = failure;
+            failure = nullptr;
+            std::rethrow_exception(thrown);
+        }
+    }
+};
+
+// Hands items from one thread to another, blocking the producer when it's full so that memory use stays capped
+template <typename Item>
+class BoundedQueue {
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+    std::deque<Item> items;
+    size_t capacity;
+    bool closed = false;
+    
+public:
+    inline BoundedQueue(size_t capacity) : capacity(std::max<size_t>(capacity, 1)) {}
+    
+    // Returns false if the queue was closed, the item is dropped then
+    inline bool push(Item item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [&] { return closed || items.size() < capacity; });
+        if(closed) return false;
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+    
+    // Returns false once the queue is closed and everything was taken from it
+    inline bool pop(Item &item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [&] { return closed || !items.empty(); });
+        if(items.empty()) return false;
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+    
+    // Nothing more will be pushed, whoever waits for items is woken up
+    inline void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+};
+
+// Remembers what a transform did to files with some contents, so that running it again skips files that didn't change since.
+// It's kept in a single local file, with the outputs of transforms that changed something stored as well.
+class RunCache {
+public:
+    struct Key {
+        uint64_t hash = 0;
+        uint64_t size = 0;
+        std::string transform;
+        
+        inline bool operator==(const Key &other) const
+        {
+            return hash == other.hash && size == other.size && transform == other.transform;
+        }
+    };
+    
+    struct Entry {
+        bool changed = false;
+        std::string output;
+        bool used = false;
+    };
+    
+private:
+    struct KeyHash {
+        inline size_t operator()(const Key &key) const
+        {
+            return key.hash ^ (std::hash<std::string>()(key.transform) * 31);
+        }
+    };
+    
+    std::string fileName;
+    std::unordered_map<Key, Entry, KeyHash> entries;
+    mutable std::mutex mutex;
+    static constexpr char magic[8] = {'E', 'U', 'C', 'A', 'C', 'H', 'E', '1'};
+    
+    template <typename Value>
+    static inline void writeValue(std::ostream &output, Value value)
+    {
+        output.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    
+    template <typename Value>
+    static inline bool readValue(std::istream &input, Value &value)
+    {
+        return bool(input.read(reinterpret_cast<char*>(&value), sizeof(value)));
+    }
+    
+    static inline void writeString(std::ostream &output, const std::string &text)
+    {
+        writeValue<uint64_t>(output, text.size());
+        output.write(text.data(), text.size());
+    }
+    
+    static inline bool readString(std::istream &input, std::string &text)
+    {
+        uint64_t size = 0;
+        if(!readValue(input, size)) return false;
+        // The length may be damaged, so the text grows only as far as there is something to read
+        text.clear();
+        while(size > 0) {
+            size_t chunk = std::min<uint64_t>(size, 1 << 16);
+            size_t read = text.size();
+            text.resize(read + chunk);
+            if(!input.read(&text[read], chunk)) return false;
+            size -= chunk;
+        }
+        return true;
+    }
+    
+public:
+    // Loads the cache if the file exists, an unreadable or damaged file is treated as an empty cache
+    inline RunCache(const std::string &fileName) : fileName(fileName)
+    {
+        std::ifstream input(fileName, std::ios::binary);
+        char header[sizeof(magic)];
+        if(!input.read(header, sizeof(header)) || std::memcmp(header, magic, sizeof(magic))) return;
+        while(input.peek() != EOF) {
+            Key key;
+            Entry entry;
+            uint8_t changed = 0;
+            if(!readValue(input, key.hash) || !readValue(input, key.size) || !readString(input, key.transform) || !readValue(input, changed)
+                    || !readString(input, entry.output)) {
+                entries.clear();
+                return;
+            }
+            entry.changed = changed;
+            entries[key] = std::move(entry);
+        }
+    }
+    RunCache(const RunCache &) = delete;
+    RunCache &operator=(const RunCache &) = delete;
+    
+    // A 64-bit hash of the contents, reading eight bytes at a time
+    static inline uint64_t contentHash(std::string_view contents)
+    {
+        uint64_t retval = 0x9E3779B97F4A7C15ull ^ contents.size();
+        size_t i = 0;
+        for(; i + 8 <= contents.size(); i += 8) {
+            uint64_t word;
+            std::memcpy(&word, contents.data() + i, 8);
+            retval = (retval ^ word) * 0xFF51AFD7ED558CCDull;
+            retval ^= retval >> 32;
+        }
+        uint64_t last = 0;
+        if(i < contents.size()) std::memcpy(&last, contents.data() + i, contents.size() - i);
+        retval = (retval ^ last) * 0xC4CEB9FE1A85EC53ull;
+        return retval ^ (retval >> 29);
+    }
+    
+    static inline Key makeKey(std::string_view contents, const std::string &transform)
+    {
+        return Key{contentHash(contents), contents.size(), transform};
+    }
+    
+    // Returns false if there's nothing about these contents
+    inline bool find(const Key &key, Entry &found)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto entry = entries.find(key);
+        if(entry == entries.end()) return false;
+        entry->second.used = true;
+        found = entry->second;
+        return true;
+    }
+    
+    inline void store(const Key &key, bool changed, std::string output)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Entry &entry = entries[key];
+        entry.changed = changed;
+        entry.output = changed ? std::move(output) : std::string();
+        entry.used = true;
+    }
+    
+    inline size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+    
+    // Forgets everything that wasn't looked up or stored since loading, to keep the cache from growing without limit
+    inline void prune()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(auto entry = entries.begin(); entry != entries.end();) {
+            if(entry->second.used) ++entry;
+            else entry = entries.erase(entry);
+        }
+    }
+    
+    // Written into a temporary file and renamed, so that an interrupted run leaves the old cache intact
+    inline void save() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::ostringstream output;
+        output.write(magic, sizeof(magic));
+        for(auto &entry : entries) {
+            writeValue(output, entry.first.hash);
+            writeValue(output, entry.first.size);
+            writeString(output, entry.first.transform);
+            writeValue<uint8_t>(output, entry.second.changed);
+            writeString(output, entry.second.output);
+        }
+        writeFileAtomically(fileName, output.str());
+    }
+};
+
+// Applies the same edits to many files at once, the transform is called once per file
+// and must return true if it changed the source (nothing is written otherwise)
+class BatchEditor {
+public:
+    struct FileResult {
+        std::string fileName;
+        bool changed = false;
+        // The transform wasn't run because the cache knew the result
+        bool cached = false;
+        std::string error;
+        double milliseconds = 0;
+    };
+
+    typedef std::function<bool(Source &)> Transform;
+
+    int threads;
+    bool oneLine = false;
+
+    inline BatchEditor(int threads = 0) : threads(threads) {}
+
+    // Supports * and ? wildcards, matched against the file name only
+    static inline bool matchesPattern(const std::string &name, const std::string &pattern)
+    {
+        size_t nameIndex = 0;
+        size_t patternIndex = 0;
+        size_t starPattern = std::string::npos;
+        size_t starName = 0;
+        while(nameIndex < name.size()) {
+            if(patternIndex < pattern.size() && (pattern[patternIndex] == '?' || pattern[patternIndex] == name[nameIndex])) {
+                nameIndex++;
+                patternIndex++;
+            }
+            else if(patternIndex < pattern.size() && pattern[patternIndex] == '*') {
+                starPattern = patternIndex++;
+                starName = nameIndex;
+            }
+            else if(starPattern != std::string::npos) {
+                patternIndex = starPattern + 1;
+                nameIndex = ++starName;
+            }
+            else return false;
+        }
+        while(patternIndex < pattern.size() && pattern[patternIndex] == '*')
+            patternIndex++;
+        return patternIndex == pattern.size();
+    }
+
+    // Lists files in the directory and its subdirectories whose names match the pattern, sorted by path
+    static inline std::vector<std::string> findFiles(const std::string &directory, const std::string &pattern)
+    {
+        std::vector<std::string> retval;
+        for(auto &entry : std::filesystem::recursive_directory_iterator(directory)) {
+            if(entry.is_regular_file() && matchesPattern(entry.path().filename().string(), pattern))
+                retval.push_back(entry.path().string());
+        }
+        std::sort(retval.begin(), retval.end());
+        return retval;
+    }
+
+    // Writes into a temporary file next to the target and renames it over the target,
+    // so that an interrupted run never leaves a half written file behind.
+    // A file that already has the contents isn't written, returns whether it was.
+    // Like in toFile, a file differing from a source only by the line break ending it is left as it is.
+    static inline bool writeAtomically(const Source &source, const std::string &fileName, bool oneLine = false)
+    {
+        return writeContentsAtomically(source.toString(oneLine), fileName, true);
+    }
+    
+    static inline bool writeContentsAtomically(std::string_view contents, const std::string &fileName, bool ignoringFinalLineBreak = false)
+    {
+        if(fileContains(fileName, contents, ignoringFinalLineBreak)) return false;
+        writeFileAtomically(fileName, contents);
+        return true;
+    }
+
+    inline FileResult editFile(const std::string &fileName, const Transform &transform) const
+    {
+        FileResult retval;
+        retval.fileName = fileName;
+        auto start = std::chrono::steady_clock::now();
+        try {
+            Source source = Source::fromFile(fileName);
+            retval.changed = transform(source);
+            if(retval.changed)
+                writeAtomically(source, fileName, oneLine);
+        }
+        catch(std::exception &exception) {
+            retval.error = exception.what();
+        }
+        retval.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return retval;
+    }
+
+    // Files whose contents the cache knows are not loaded into a Source at all, files the transform doesn't change
+    // are only read and hashed. The identity must change whenever the transform does something else than before.
+    inline FileResult editFile(const std::string &fileName, const Transform &transform, RunCache &cache, const std::string &transformIdentity) const
+    {
+        FileResult retval;
+        retval.fileName = fileName;
+        auto start = std::chrono::steady_clock::now();
+        try {
+            RunCache::Key key = RunCache::makeKey(MappedFile(fileName).view(), transformIdentity + (oneLine ? "\n1" : "\n0"));
+            RunCache::Entry entry;
+            if(cache.find(key, entry)) {
+                retval.cached = true;
+                retval.changed = entry.changed;
+                if(entry.changed)
+                    writeContentsAtomically(entry.output, fileName, true);
+            }
+            else {
+                Source source = Source::fromFile(fileName);
+                retval.changed = transform(source);
+                std::string output = retval.changed ? source.toString(oneLine) : std::string();
+                if(retval.changed)
+                    writeContentsAtomically(output, fileName, true);
+                cache.store(key, retval.changed, std::move(output));
+            }
+        }
+        catch(std::exception &exception) {
+            retval.error = exception.what();
+        }
+        retval.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return retval;
+    }
+    
+    // The results are in the same order as the files
+    inline std::vector<FileResult> run(const std::vector<std::string> &files, const Transform &transform) const
+    {
+        std::vector<FileResult> retval(files.size());
+        ThreadPool pool(threads);
+        for(int i = 0; i < (int)files.size(); i++) {
+            pool.submit([&, i] {
+                retval[i] = editFile(files[i], transform);
+            });
+        }
+        pool.wait();
+        return retval;
+    }
+    
+    // Uses and updates the cache and saves it after the run
+    inline std::vector<FileResult> run(const std::vector<std::string> &files, const Transform &transform, RunCache &cache,
+                                       const std::string &transformIdentity) const
+    {
+        std::vector<FileResult> retval(files.size());
+        ThreadPool pool(threads);
+        for(int i = 0; i < (int)files.size(); i++) {
+            pool.submit([&, i] {
+                retval[i] = editFile(files[i], transform, cache, transformIdentity);
+            });
+        }
+        pool.wait();
+        cache.save();
+        return retval;
+    }
+    
+    // Reads, transforms and writes in separate stages connected by queues of the given size, so that reading and writing files
+    // overlaps with the transforms. One thread reads the files ahead, the transforms run on the editor's threads and one thread writes.
+    // A file is only written if its new contents differ from the old ones. io_uring isn't used, to keep this dependency free.
+    inline std::vector<FileResult> runPipelined(const std::vector<std::string> &files, const Transform &transform, int queueSize = 0) const
+    {
+        struct Loaded {
+            int index = 0;
+            std::string contents;
+        };
+        struct Transformed {
+            int index = 0;
+            std::string contents;
+        };
+        int workers = threads > 0 ? threads : std::max<int>(1, std::thread::hardware_concurrency());
+        if(queueSize <= 0) queueSize = 2 * workers;
+        std::vector<FileResult> retval(files.size());
+        BoundedQueue<Loaded> loaded(queueSize);
+        BoundedQueue<Transformed> transformed(queueSize);
+        auto elapsed = [] (std::chrono::steady_clock::time_point start) {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        };
+        
+        std::thread reader([&] {
+            for(int i = 0; i < (int)files.size(); i++) {
+                retval[i].fileName = files[i];
+                auto start = std::chrono::steady_clock::now();
+                Loaded file;
+                file.index = i;
+                try {
+                    MappedFile mapped(files[i]);
+                    file.contents.assign(mapped.data() ? mapped.data() : "", mapped.size());
+                }
+                catch(std::exception &exception) {
+                    retval[i].error = exception.what();
+                    retval[i].milliseconds = elapsed(start);
+                    continue;
+                }
+                retval[i].milliseconds = elapsed(start);
+                if(!loaded.push(std::move(file))) break;
+            }
+            loaded.close();
+        });
+        
+        std::vector<std::thread> transformers;
+        std::atomic<int> transformersLeft{workers};
+        for(int worker = 0; worker < workers; worker++) {
+            transformers.emplace_back([&] {
+                Loaded file;
+                while(loaded.pop(file)) {
+                    FileResult &result = retval[file.index];
+                    auto start = std::chrono::steady_clock::now();
+                    std::string output;
+                    try {
+                        Source source(file.contents);
+                        if(transform(source)) {
+                            output = source.toString(oneLine);
+                            // Compared with how the untouched file would be written, which may differ from it in line breaks
+                            result.changed = output != Source(file.contents).toString(oneLine);
+                        }
+                    }
+                    catch(std::exception &exception) {
+                        result.error = exception.what();
+                    }
+                    // Once the file is pushed, its result belongs to the writer
+                    result.milliseconds += elapsed(start);
+                    if(result.changed) transformed.push(Transformed{file.index, std::move(output)});
+                }
+                if(--transformersLeft == 0) transformed.close();
+            });
+        }
+        
+        std::thread writer([&] {
+            Transformed file;
+            while(transformed.pop(file)) {
+                FileResult &result = retval[file.index];
+                auto start = std::chrono::steady_clock::now();
+                try {
+                    writeContentsAtomically(file.contents, files[file.index]);
+                }
+                catch(std::exception &exception) {
+                    result.error = exception.what();
+                }
+                result.milliseconds += elapsed(start);
+            }
+        });
+        
+        reader.join();
+        for(auto &transformer : transformers)
+            transformer.join();
+        writer.join();
+        return retval;
+    }
+    
+    inline std::vector<FileResult> runPipelined(const std::string &directory, const std::string &pattern, const Transform &transform, int queueSize = 0) const
+    {
+        return runPipelined(findFiles(directory, pattern), transform, queueSize);
+    }
+    
+    inline std::vector<FileResult> run(const std::string &directory, const std::string &pattern, const Transform &transform, RunCache &cache,
+                                       const std::string &transformIdentity) const
+    {
+        return run(findFiles(directory, pattern), transform, cache, transformIdentity);
+    }
+
+    inline std::vector<FileResult> run(const std::string &directory, const std::string &pattern, const Transform &transform) const
+    {
+        return run(findFiles(directory, pattern), transform);
+    }
+
+    // Prints the slowest files and all failures, the number of slowest files can be zero
+    static inline void printReport(const std::vector<FileResult> &results, std::ostream &output = std::cout, int slowest = 10)
+    {
+        int changed = 0;
+        int cached = 0;
+        int failed = 0;
+        double total = 0;
+        for(auto &result : results) {
+            if(result.changed) changed++;
+            if(result.cached) cached++;
+            if(!result.error.empty()) failed++;
+            total += result.milliseconds;
+        }
+        std::lock_guard<std::mutex> lock(Source::reportMutex());
+        std::ios_base::fmtflags flags = output.flags();
+        std::streamsize precision = output.precision();
+        output << results.size() << " files processed, " << changed << " changed, " << cached << " known from cache, " << failed << " failed, "
+               << std::fixed << std::setprecision(1) << total << " ms spent in total" << std::endl;
+        std::vector<const FileResult*> sorted;
+        for(auto &result : results)
+            sorted.push_back(&result);
+        std::sort(sorted.begin(), sorted.end(), [] (const FileResult *first, const FileResult *second) {
+            return first->milliseconds > second->milliseconds;
+        });
+        for(int i = 0; i < slowest && i < (int)sorted.size(); i++)
+            output << "  " << std::setw(10) << sorted[i]->milliseconds << " ms  " << sorted[i]->fileName << std::endl;
+        for(auto &result : results)
+            if(!result.error.empty())
+                output << "Failed " << result.fileName << ": " << result.error << std::endl;
+        output.flags(flags);
+        output.precision(precision);
+    }
+};
+
+// Where every identifier of many files is declared, assigned to or used, so that finding where the variable given by whatIsItAssignedTo
+// is declared or used in other files doesn't need all the files to be scanned again. It's kept in a single local file that is mapped
+// into memory and searched with a binary search, and update() lexes again only the files whose contents changed.
+// The roles are guessed from the tokens around the identifiers, without parsing.
+class SymbolIndex {
+public:
+    enum Role : uint8_t { Declaration, Assignment, Use };
+    
+    struct Occurrence {
+        std::string_view file;
+        int line;
+        int column;
+        Role role;
+    };
+    
+    struct Symbol {
+        std::string_view name;
+        uint64_t hash;
+        int line;
+        int column;
+        Role role;
+    };
+    
+private:
+    // The file is the header followed by arrays of these records and by the text of the file and symbol names,
+    // in the byte order of the machine, it's meant to be a local file like the one of RunCache
+    struct Header {
+        char magic[8];
+        uint32_t fileCount;
+        uint32_t symbolCount;
+        uint64_t occurrenceCount;
+        uint64_t textSize;
+    };
+    struct FileRecord {
+        uint64_t contentHash;
+        uint64_t size;
+        uint32_t nameOffset;
+        uint32_t nameLength;
+    };
+    // Sorted by hash and name, the occurrences of every symbol are consecutive and sorted by file and position
+    struct SymbolRecord {
+        uint64_t hash;
+        uint32_t nameOffset;
+        uint32_t nameLength;
+        uint32_t firstOccurrence;
+        uint32_t occurrenceCount;
+    };
+    struct OccurrenceRecord {
+        uint32_t file;
+        uint32_t line;
+        uint32_t columnAndRole; // The role is in the two highest bits
+    };
+    static constexpr char magic[8] = {'E', 'U', 'S', 'Y', 'M', 'B', 'O', '1'};
+    static constexpr uint32_t columnMask = (1u << 30) - 1;
+    
+    std::string fileName;
+    std::shared_ptr<const MappedFile> mapped;
+    Header header{};
+    const FileRecord *fileRecords = nullptr;
+    const SymbolRecord *symbolRecords = nullptr;
+    const OccurrenceRecord *occurrenceRecords = nullptr;
+    const char *text = nullptr;
+    
+    inline std::string_view textAt(uint32_t offset, uint32_t length) const
+    {
+        return std::string_view(text + offset, length);
+    }
+    
+    // A missing or damaged file leaves the index empty
+    inline void load()
+    {
+        mapped = nullptr;
+        header = Header{};
+        std::shared_ptr<const MappedFile> file;
+        try {
+            file = std::make_shared<const MappedFile>(fileName);
+        }
+        catch(std::runtime_error &) {
+            return;
+        }
+        Header read;
+        if(file->size() < sizeof(read)) return;
+        std::memcpy(&read, file->data(), sizeof(read));
+        uint64_t filesEnd = sizeof(Header) + uint64_t(read.fileCount) * sizeof(FileRecord);
+        uint64_t symbolsEnd = filesEnd + uint64_t(read.symbolCount) * sizeof(SymbolRecord);
+        if(std::memcmp(read.magic, magic, sizeof(magic)) || read.occurrenceCount > file->size() || read.textSize > file->size()
+                || symbolsEnd + read.occurrenceCount * sizeof(OccurrenceRecord) + read.textSize != file->size())
+            return;
+        auto files = reinterpret_cast<const FileRecord*>(file->data() + sizeof(Header));
+        auto symbols = reinterpret_cast<const SymbolRecord*>(file->data() + filesEnd);
+        auto occurrences = reinterpret_cast<const OccurrenceRecord*>(file->data() + symbolsEnd);
+        for(uint32_t i = 0; i < read.fileCount; i++)
+            if(uint64_t(files[i].nameOffset) + files[i].nameLength > read.textSize) return;
+        uint64_t occurrence = 0;
+        for(uint32_t i = 0; i < read.symbolCount; i++) {
+            if(uint64_t(symbols[i].nameOffset) + symbols[i].nameLength > read.textSize || symbols[i].firstOccurrence != occurrence) return;
+            occurrence += symbols[i].occurrenceCount;
+        }
+        if(occurrence != read.occurrenceCount) return;
+        for(uint64_t i = 0; i < read.occurrenceCount; i++)
+            if(occurrences[i].file >= read.fileCount) return;
+        header = read;
+        fileRecords = files;
+        symbolRecords = symbols;
+        occurrenceRecords = occurrences;
+        text = file->data() + symbolsEnd + read.occurrenceCount * sizeof(OccurrenceRecord);
+        mapped = std::move(file);
+    }
+    
+    static inline bool isKeyword(std::string_view name)
+    {
+        static const std::unordered_set<std::string_view> keywords = {
+            "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor", "bool", "break", "case", "catch", "char", "char8_t",
+            "char16_t", "char32_t", "class", "compl", "concept", "const", "consteval", "constexpr", "constinit", "const_cast", "continue",
+            "co_await", "co_return", "co_yield", "decltype", "default", "delete", "do", "double", "dynamic_cast", "else", "enum", "explicit",
+            "export", "extern", "false", "final", "float", "for", "friend", "goto", "if", "inline", "int", "long", "mutable", "namespace",
+            "new", "noexcept", "not", "not_eq", "nullptr", "operator", "or", "or_eq", "override", "private", "protected", "public", "register",
+            "reinterpret_cast", "requires", "return", "short", "signed", "sizeof", "static", "static_assert", "static_cast", "struct",
+            "switch", "template", "this", "thread_local", "throw", "true", "try", "typedef", "typeid", "typename", "union", "unsigned",
+            "using", "virtual", "void", "volatile", "wchar_t", "while", "xor", "xor_eq"};
+        return keywords.count(name) > 0;
+    }
+    
+    // Keywords after which an identifier is an expression, not a declared name
+    static inline bool precedesExpression(std::string_view name)
+    {
+        static const std::unordered_set<std::string_view> keywords = {
+            "return", "case", "goto", "throw", "new", "delete", "else", "do", "sizeof", "alignof", "co_return", "co_yield", "co_await",
+            "operator", "typeid", "not", "and", "or", "xor", "bitand", "bitor", "compl", "and_eq", "or_eq", "xor_eq", "not_eq"};
+        return keywords.count(name) > 0;
+    }
+    
+public:
+    // Loads the index if the file exists, an unreadable or damaged file is treated as an empty index
+    inline SymbolIndex(const std::string &fileName) : fileName(fileName)
+    {
+        load();
+    }
+    SymbolIndex(const SymbolIndex &) = delete;
+    SymbolIndex &operator=(const SymbolIndex &) = delete;
+    
+    inline size_t fileCount() const
+    {
+        return header.fileCount;
+    }
+    
+    inline size_t symbolCount() const
+    {
+        return header.symbolCount;
+    }
+    
+    // Sorted by file (in the order they were given to update) and position, in O(log n) of the number of symbols.
+    // The views of the file names are valid until the next update.
+    inline std::vector<Occurrence> find(std::string_view identifier) const
+    {
+        std::vector<Occurrence> retval;
+        uint64_t hashed = TokenIndex::hash(identifier);
+        const SymbolRecord *end = symbolRecords + header.symbolCount;
+        const SymbolRecord *symbol = std::lower_bound(symbolRecords, end, identifier, [&] (const SymbolRecord &record, std::string_view sought) {
+            return record.hash < hashed || (record.hash == hashed && textAt(record.nameOffset, record.nameLength) < sought);
+        });
+        if(symbol == end || symbol->hash != hashed || textAt(symbol->nameOffset, symbol->nameLength) != identifier) return retval;
+        retval.reserve(symbol->occurrenceCount);
+        for(uint32_t i = symbol->firstOccurrence; i < symbol->firstOccurrence + symbol->occurrenceCount; i++) {
+            const OccurrenceRecord &occurrence = occurrenceRecords[i];
+            const FileRecord &file = fileRecords[occurrence.file];
+            retval.push_back(Occurrence{textAt(file.nameOffset, file.nameLength), int(occurrence.line), int(occurrence.columnAndRole & columnMask),
+                                        Role(occurrence.columnAndRole >> 30)});
+        }
+        return retval;
+    }
+    
+    inline std::vector<Occurrence> find(std::string_view identifier, Role role) const
+    {
+        std::vector<Occurrence> retval = find(identifier);
+        retval.erase(std::remove_if(retval.begin(), retval.end(), [&] (const Occurrence &occurrence) { return occurrence.role != role; }), retval.end());
+        return retval;
+    }
+    
+    // The identifiers of the source as they go into the index, keywords are left out.
+    // A declared name follows a type (an identifier that isn't a keyword like return, a closing template bracket or a pointer
+    // or reference declarator written next to one of them) and is followed by something that can follow a declared name.
+    // Assignments are followed by = or a compound assignment.
+    template <typename Line>
+    static inline std::vector<Symbol> symbolsIn(const BasicSource<Line> &source)
+    {
+        TokenIndex index(source);
+        std::vector<const TokenIndex::Token*> code;
+        for(const TokenIndex::Token &token : index.tokens)
+            if(token.isCode()) code.push_back(&token);
+        auto is = [&] (int position, char character) {
+            return position >= 0 && position < (int)code.size() && code[position]->kind == TokenIndex::Punctuation
+                   && source.lines[code[position]->line][code[position]->column] == character;
+        };
+        auto isOneOf = [&] (int position, const char *characters) {
+            for(; *characters; characters++)
+                if(is(position, *characters)) return true;
+            return false;
+        };
+        // Whether there's no space between the token and the next one
+        auto adjacent = [&] (int position) {
+            return position >= 0 && position + 1 < (int)code.size() && code[position]->line == code[position + 1]->line
+                   && code[position]->column + code[position]->length == code[position + 1]->column;
+        };
+        auto roleOf = [&] (int position) {
+            bool declarable = (isOneOf(position + 1, ";,(){[>") || (is(position + 1, '=') && !is(position + 2, '='))
+                               || (is(position + 1, ':') && !is(position + 2, ':')));
+            int type = position - 1;
+            while(isOneOf(type, "*&"))
+                type--;
+            if(type < position - 1 && !adjacent(type) && !adjacent(position - 1)) type = -1;
+            bool afterType = type >= 0 && ((code[type]->kind == TokenIndex::Identifier && !precedesExpression(TokenIndex::text(source, *code[type])))
+                                           || (is(type, '>') && adjacent(type - 1)));
+            if(afterType && declarable) return Declaration;
+            if(is(position + 1, '=') && !is(position + 2, '=')) return Assignment;
+            if(isOneOf(position + 1, "+-*/%&|^") && is(position + 2, '=') && adjacent(position + 1) && !is(position + 3, '=')) return Assignment;
+            if((is(position + 1, '<') && is(position + 2, '<')) || (is(position + 1, '>') && is(position + 2, '>'))) {
+                if(is(position + 3, '=') && adjacent(position + 1) && adjacent(position + 2)) return Assignment;
+            }
+            return Use;
+        };
+        std::vector<Symbol> retval;
+        for(int i = 0; i < (int)code.size(); i++) {
+            if(code[i]->kind != TokenIndex::Identifier) continue;
+            std::string_view name = TokenIndex::text(source, *code[i]);
+            if(isKeyword(name)) continue;
+            retval.push_back(Symbol{name, code[i]->hash, code[i]->line, code[i]->column, roleOf(i)});
+        }
+        return retval;
+    }
+    
+    // Lexes the files that aren't in the index with the same contents in parallel, takes the others from the index and saves it.
+    // Files that aren't in the list or can't be read are left out of the index. Returns the number of files that were lexed.
+    // The file isn't written if nothing changed.
+    inline int update(const std::vector<std::string> &files, int threads = 0)
+    {
+        struct Found {
+            uint64_t hash;
+            std::string_view name;
+            uint32_t file;
+            uint32_t line;
+            uint32_t column;
+            Role role;
+        };
+        struct Scanned {
+            bool readable = false;
+            int previous = -1; // The file in the index with the same contents
+            uint64_t contentHash = 0;
+            uint64_t size = 0;
+            std::shared_ptr<const MappedFile> contents; // The names found point into it
+            std::vector<Found> found;
+        };
+        std::unordered_map<std::string_view, int> known;
+        for(uint32_t i = 0; i < header.fileCount; i++)
+            known.emplace(textAt(fileRecords[i].nameOffset, fileRecords[i].nameLength), i);
+        std::vector<Scanned> scanned(files.size());
+        std::atomic<int> lexed{0};
+        {
+            ThreadPool pool(threads);
+            for(int i = 0; i < (int)files.size(); i++) {
+                pool.submit([&, i] {
+                    Scanned &file = scanned[i];
+                    try {
+                        auto contents = std::make_shared<const MappedFile>(files[i]);
+                        file.contentHash = RunCache::contentHash(contents->view());
+                        file.size = contents->size();
+                        file.readable = true;
+                        auto previous = known.find(files[i]);
+                        if(previous != known.end() && fileRecords[previous->second].contentHash == file.contentHash
+                                && fileRecords[previous->second].size == file.size) {
+                            file.previous = previous->second;
+                            return;
+                        }
+                        SourceView source(SourceView::splitLines(contents->view()));
+                        for(const Symbol &symbol : symbolsIn(source))
+                            file.found.push_back(Found{symbol.hash, symbol.name, uint32_t(i), uint32_t(symbol.line), uint32_t(symbol.column), symbol.role});
+                        file.contents = std::move(contents);
+                        lexed++;
+                    }
+                    catch(std::runtime_error &) {
+                        file.readable = false;
+                    }
+                });
+            }
+            pool.wait();
+        }
+        // The same files with the same contents
+        bool unchanged = files.size() == header.fileCount;
+        for(int i = 0; i < (int)scanned.size() && unchanged; i++)
+            unchanged = scanned[i].previous == i;
+        if(unchanged) return 0;
+        
+        std::vector<Found> all;
+        for(Scanned &file : scanned) {
+            all.insert(all.end(), file.found.begin(), file.found.end());
+            file.found = std::vector<Found>();
+        }
+        // Unchanged files are only renumbered
+        std::vector<int> kept(header.fileCount, -1);
+        for(int i = 0; i < (int)scanned.size(); i++)
+            if(scanned[i].previous >= 0) kept[scanned[i].previous] = i;
+        for(uint32_t i = 0; i < header.symbolCount; i++) {
+            const SymbolRecord &symbol = symbolRecords[i];
+            std::string_view name = textAt(symbol.nameOffset, symbol.nameLength);
+            for(uint32_t j = symbol.firstOccurrence; j < symbol.firstOccurrence + symbol.occurrenceCount; j++) {
+                const OccurrenceRecord &occurrence = occurrenceRecords[j];
+                if(kept[occurrence.file] >= 0)
+                    all.push_back(Found{symbol.hash, name, uint32_t(kept[occurrence.file]), occurrence.line, occurrence.columnAndRole & columnMask,
+                                        Role(occurrence.columnAndRole >> 30)});
+            }
+        }
+        std::sort(all.begin(), all.end(), [] (const Found &first, const Found &second) {
+            if(first.hash != second.hash) return first.hash < second.hash;
+            if(first.name != second.name) return first.name < second.name;
+            if(first.file != second.file) return first.file < second.file;
+            if(first.line != second.line) return first.line < second.line;
+            return first.column < second.column;
+        });
+        
+        Header written{};
+        std::memcpy(written.magic, magic, sizeof(magic));
+        std::vector<FileRecord> fileOutput;
+        std::vector<SymbolRecord> symbolOutput;
+        std::vector<OccurrenceRecord> occurrenceOutput;
+        occurrenceOutput.reserve(all.size());
+        std::string textOutput;
+        std::vector<uint32_t> renumbered(files.size());
+        for(int i = 0; i < (int)files.size(); i++) {
+            if(!scanned[i].readable) continue;
+            renumbered[i] = fileOutput.size();
+            fileOutput.push_back(FileRecord{scanned[i].contentHash, scanned[i].size, uint32_t(textOutput.size()), uint32_t(files[i].size())});
+            textOutput += files[i];
+        }
+        for(size_t i = 0; i < all.size(); i++) {
+            const Found &found = all[i];
+            if(i == 0 || found.hash != all[i - 1].hash || found.name != all[i - 1].name) {
+                symbolOutput.push_back(SymbolRecord{found.hash, uint32_t(textOutput.size()), uint32_t(found.name.size()), uint32_t(occurrenceOutput.size()), 0});
+                textOutput.append(found.name);
+            }
+            symbolOutput.back().occurrenceCount++;
+            occurrenceOutput.push_back(OccurrenceRecord{renumbered[found.file], found.line, (found.column & columnMask) | (uint32_t(found.role) << 30)});
+        }
+        written.fileCount = fileOutput.size();
+        written.symbolCount = symbolOutput.size();
+        written.occurrenceCount = occurrenceOutput.size();
+        written.textSize = textOutput.size();
+        
+        std::string output;
+        output.reserve(sizeof(written) + fileOutput.size() * sizeof(FileRecord) + symbolOutput.size() * sizeof(SymbolRecord)
+                       + occurrenceOutput.size() * sizeof(OccurrenceRecord) + textOutput.size());
+        output.append(reinterpret_cast<const char*>(&written), sizeof(written));
+        output.append(reinterpret_cast<const char*>(fileOutput.data()), fileOutput.size() * sizeof(FileRecord));
+        output.append(reinterpret_cast<const char*>(symbolOutput.data()), symbolOutput.size() * sizeof(SymbolRecord));
+        output.append(reinterpret_cast<const char*>(occurrenceOutput.data()), occurrenceOutput.size() * sizeof(OccurrenceRecord));
+        output.append(textOutput);
+        BatchEditor::writeContentsAtomically(output, fileName);
+        load();
+        return lexed;
+    }
+    
+    inline int update(const std::string &directory, const std::string &pattern, int threads = 0)
+    {
+        return update(BatchEditor::findFiles(directory, pattern), threads);
+    }
+};
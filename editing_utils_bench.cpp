@@ -0,0 +1,607 @@
+#include "editing_utils.h"
+#include "editing_utils_batch.h"
+#include <benchmark/benchmark.h>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <filesystem>
+#include <sys/resource.h>
+
+// Every allocation in the benchmark is counted, to show which functions allocate in hot loops
+static std::atomic<int64_t> allocations{0};
+
+void *operator new(size_t size)
+{
+    allocations++;
+    if(void *retval = std::malloc(size ? size : 1)) return retval;
+    throw std::bad_alloc();
+}
+
+// Not inlined, so that the compiler doesn't take the free() for a mismatch with new
+__attribute__((noinline)) void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+__attribute__((noinline)) void operator delete(void *pointer, size_t) noexcept
+{
+    std::free(pointer);
+}
+
+// Generates the same C++ like text on every run and every platform (std::mt19937 is fully specified, unlike the distributions),
+// with deeply nested blocks and calls, long string literals, block comments spanning lines and some lines ending with CRLF
+static std::string generatedCorpus(size_t size)
+{
+    std::mt19937 random(20240611);
+    auto pick = [&] (int count) { return int(random() % count); };
+    static const char *names[] = {"value", "first", "second", "index", "count", "buffer", "result", "node", "parent", "entry"};
+    auto name = [&] { return std::string(names[pick(10)]) + std::to_string(pick(100)); };
+    std::function<std::string(int)> expression = [&] (int level) -> std::string {
+        if(level == 0 || pick(3) == 0) return pick(4) ? name() : std::to_string(pick(10000));
+        std::string retval = name() + (pick(4) ? "(" : "{");
+        char closing = retval.back() == '(' ? ')' : '}';
+        int arguments = 1 + pick(3);
+        for(int i = 0; i < arguments; i++)
+            retval += (i ? ", " : "") + expression(level - 1);
+        return retval + closing;
+    };
+    auto literal = [&] {
+        std::string retval = "\"";
+        int length = 20 + pick(300);
+        for(int i = 0; i < length; i++)
+            retval.push_back(pick(20) ? char('a' + pick(26)) : pick(2) ? ' ' : ',');
+        return retval + "\"";
+    };
+    std::string retval;
+    int depth = 0;
+    auto endLine = [&] {
+        retval += pick(8) ? "\n" : "\r\n";
+        retval.append(depth * 4, ' ');
+    };
+    while(retval.size() < size) {
+        retval += "/* " + name() + " computes " + name() + " from";
+        endLine();
+        retval += " * " + name() + " and " + name() + " */";
+        endLine();
+        retval += "std::vector<int> " + name() + "(const std::string& " + name() + ", int " + name() + ")";
+        endLine();
+        retval += "{";
+        depth++;
+        endLine();
+        int statements = 20 + pick(40);
+        for(int i = 0; i < statements; i++) {
+            switch(pick(7)) {
+            case 0:
+                if(depth < 16) {
+                    retval += "if(" + expression(4) + ") {";
+                    depth++;
+                    break;
+                }
+                [[fallthrough]];
+            case 1:
+                if(depth > 1) {
+                    retval.resize(retval.size() - 4);
+                    retval += "}";
+                    depth--;
+                    break;
+                }
+                [[fallthrough]];
+            case 2:
+                retval += "auto " + name() + " = " + literal() + ";";
+                break;
+            case 3:
+                retval += expression(6) + ";";
+                break;
+            case 4:
+                retval += "/* " + name() + " is";
+                endLine();
+                retval += "   " + literal() + " */";
+                break;
+            case 5:
+                retval += "std::vector<int> " + name() + " = {" + expression(2) + ", " + expression(2) + "};";
+                break;
+            default:
+                retval += "int " + name() + " = " + name() + "; // " + name();
+            }
+            endLine();
+        }
+        while(depth > 0) {
+            retval.resize(retval.size() - 4);
+            retval += "}";
+            depth--;
+            endLine();
+        }
+        retval += "\n";
+    }
+    return retval;
+}
+
+// Files to measure on can be given as a colon separated list in EDITING_UTILS_BENCH_FILES,
+// otherwise 16 MB of generated code is used
+static const Source &benchmarkedSource()
+{
+    static const Source source = [] {
+        const char *given = std::getenv("EDITING_UTILS_BENCH_FILES");
+        if(!given) return Source(generatedCorpus(16 << 20));
+        std::stringstream list(given);
+        std::string file;
+        std::string text;
+        while(std::getline(list, file, ':'))
+            if(!file.empty()) text += Source::fromFile(file).toString() + "\n";
+        return Source(text);
+    }();
+    return source;
+}
+
+static int64_t sourceSize(const Source &source)
+{
+    int64_t retval = 0;
+    for(auto &line : source.lines)
+        retval += line.size() + 1;
+    return retval;
+}
+
+// The argument is the CharacterScanner kernel to use
+static bool useKernel(benchmark::State &state)
+{
+    CharacterScanner::Kernel kernel = CharacterScanner::Kernel(state.range(0));
+    if(!CharacterScanner::supported(kernel)) {
+        state.SkipWithError("Kernel not supported by this processor");
+        return false;
+    }
+    CharacterScanner::setKernel(kernel);
+    state.SetLabel(kernel == CharacterScanner::Scalar ? "scalar" : kernel == CharacterScanner::SSE2 ? "SSE2" : "AVX2");
+    return true;
+}
+
+// Allocations per call and the peak resident memory of the whole process so far
+static void countAllocations(benchmark::State &state, int64_t allocationsBefore, int64_t calls)
+{
+    state.counters["allocations/call"] = benchmark::Counter(double(allocations - allocationsBefore) / std::max<int64_t>(calls, 1));
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    state.counters["peakRSS_MB"] = benchmark::Counter(usage.ru_maxrss / 1024.0);
+}
+
+static void normaliseLineBenchmark(benchmark::State &state)
+{
+    if(!useKernel(state)) return;
+    const Source &source = benchmarkedSource();
+    int64_t allocationsBefore = allocations;
+    for(auto _ : state) {
+        for(auto &line : source.lines)
+            benchmark::DoNotOptimize(Source::normaliseLine(line));
+    }
+    state.SetBytesProcessed(state.iterations() * sourceSize(source));
+    countAllocations(state, allocationsBefore, state.iterations());
+}
+BENCHMARK(normaliseLineBenchmark)->DenseRange(CharacterScanner::Scalar, CharacterScanner::AVX2)->Unit(benchmark::kMillisecond);
+
+// normaliseLine as it was before it used the lexer, kept only to compare the speed. It toggled literals on unescaped quotes
+// and cut the line at the first two slashes, so it got block comments, character literals, escaped backslashes and raw strings wrong.
+static std::string quoteTogglingNormaliseLine(const std::string &input)
+{
+    std::string retval;
+    retval.reserve(input.size());
+    bool literalActive = false;
+    size_t copied = 0;
+    CharacterScanner::forEach(input.data(), input.size(), [] (const CharacterScanner::Masks &masks) {
+        return masks.quote | masks.slash | masks.whitespace;
+    }, [&] (int i) {
+        retval.append(input, copied, i - copied);
+        copied = i + 1;
+        if(input[i] == '"' && (i == 0 || input[i - 1] != '\\'))
+            literalActive = !literalActive;
+        if(input[i] == '/' && input[i + 1] == '/') {
+            copied = input.size();
+            return false;
+        }
+        else if(input[i] == '\r')
+            return true;
+        else if(input[i] != ' ' && input[i] != '\t')
+            retval.push_back(input[i]);
+        else if(literalActive || (i > 0 && Source::isValidIdentifierChar(input[i - 1]) && Source::isValidIdentifierChar(input[i + 1])))
+            retval.push_back(' ');
+        return true;
+    });
+    retval.append(input, copied, std::string::npos);
+    return retval;
+}
+
+static void quoteTogglingNormaliseLineBenchmark(benchmark::State &state)
+{
+    if(!useKernel(state)) return;
+    const Source &source = benchmarkedSource();
+    int64_t allocationsBefore = allocations;
+    for(auto _ : state) {
+        for(auto &line : source.lines)
+            benchmark::DoNotOptimize(quoteTogglingNormaliseLine(line));
+    }
+    state.SetBytesProcessed(state.iterations() * sourceSize(source));
+    countAllocations(state, allocationsBefore, state.iterations());
+}
+BENCHMARK(quoteTogglingNormaliseLineBenchmark)->DenseRange(CharacterScanner::Scalar, CharacterScanner::AVX2)->Unit(benchmark::kMillisecond);
+
+static void cleanAllBenchmark(benchmark::State &state)
+{
+    if(!useKernel(state)) return;
+    const Source &source = benchmarkedSource();
+    int64_t allocationsBefore = allocations;
+    for(auto _ : state)
+        benchmark::DoNotOptimize(Source::cleanAll(source));
+    state.SetBytesProcessed(state.iterations() * sourceSize(source));
+    countAllocations(state, allocationsBefore, state.iterations());
+}
+BENCHMARK(cleanAllBenchmark)->DenseRange(CharacterScanner::Scalar, CharacterScanner::AVX2)->Unit(benchmark::kMillisecond);
+
+static void skipWhitespaceBenchmark(benchmark::State &state)
+{
+    if(!useKernel(state)) return;
+    const Source &source = benchmarkedSource();
+    int64_t allocationsBefore = allocations;
+    for(auto _ : state) {
+        int64_t sum = 0;
+        for(int i = 0; i < (int)source.lines.size(); i++)
+            sum += source.skipWhitespace(i, 0) + source.skipWhitespaceLines(i);
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetBytesProcessed(state.iterations() * sourceSize(source));
+    countAllocations(state, allocationsBefore, state.iterations());
+}
+BENCHMARK(skipWhitespaceBenchmark)->DenseRange(CharacterScanner::Scalar, CharacterScanner::AVX2)->Unit(benchmark::kMillisecond);
+
+static void streamingNormaliserBenchmark(benchmark::State &state)
+{
+    const Source &source = benchmarkedSource();
+    std::string text = source.toString();
+    int64_t allocationsBefore = allocations;
+    for(auto _ : state) {
+        int64_t normalised = 0;
+        StreamingNormaliser normaliser([&] (std::string_view piece) { normalised += piece.size(); });
+        for(size_t done = 0; done < text.size(); done += 1 << 16)
+            normaliser.feed(std::string_view(text).substr(done, 1 << 16));
+        normaliser.finish();
+        benchmark::DoNotOptimize(normalised);
+    }
+    state.SetBytesProcessed(state.iterations() * sourceSize(source));
+    countAllocations(state, allocationsBefore, state.iterations());
+}
+BENCHMARK(streamingNormaliserBenchmark)->Unit(benchmark::kMillisecond);
+
+// Argument lists and declarations like the ones rewrite loops take apart, half of them spanning lines
+static const Source &listSource()
+{
+    static const Source source = [] {
+        std::string text;
+        for(int i = 0; i < 1000; i++) {
+            text += "call(const std::string& first" + std::to_string(i) + ", \"literal, " + std::to_string(i) + "\", nested(a, b, c), ";
+            text += (i % 2) ? "\n    " : "";
+            text += "std::vector<int> &last);\n";
+        }
+        return Source(text);
+    }();
+    return source;
+}
+
+static void parseListBenchmark(benchmark::State &state)
+{
+    const Source &source = listSource();
+    int64_t allocationsBefore = allocations;
+    int64_t calls = 0;
+    for(auto _ : state) {
+        for(int i = 0; i < (int)source.lines.size(); i++) {
+            if(source.lines[i].compare(0, 5, "call(") != 0) continue;
+            for(auto &element : source.parseList(i, 5, ',', ')', '('))
+                benchmark::DoNotOptimize(Source::removeReference(Source::removeConst(element)));
+            benchmark::DoNotOptimize(Source::getStringLiteral(source.lines[i]));
+            benchmark::DoNotOptimize(source.getTillEndOfList(i, 4, '(', ')'));
+            calls++;
+        }
+    }
+    countAllocations(state, allocationsBefore, calls);
+}
+BENCHMARK(parseListBenchmark)->Unit(benchmark::kMillisecond);
+
+static void parseListViewsBenchmark(benchmark::State &state)
+{
+    const Source &source = listSource();
+    TextArena arena;
+    std::vector<std::string_view> elements;
+    int64_t allocationsBefore = allocations;
+    int64_t calls = 0;
+    for(auto _ : state) {
+        for(int i = 0; i < (int)source.lines.size(); i++) {
+            if(source.lines[i].compare(0, 5, "call(") != 0) continue;
+            arena.clear();
+            elements.clear();
+            source.parseList(std::back_inserter(elements), arena, i, 5, ',', ')', '(');
+            for(auto element : elements)
+                benchmark::DoNotOptimize(Source::removeReference(Source::removeConst(element, arena), arena));
+            benchmark::DoNotOptimize(Source::getStringLiteral(std::string_view(source.lines[i]), arena));
+            benchmark::DoNotOptimize(source.getTillEndOfList(arena, i, 4, '(', ')'));
+            calls++;
+        }
+    }
+    countAllocations(state, allocationsBefore, calls);
+}
+BENCHMARK(parseListViewsBenchmark)->Unit(benchmark::kMillisecond);
+
+// Takes apart the same calls as the parseList benchmarks with one pattern, with the tokens indexed (1) or not (0) beforehand
+static void structuralPatternBenchmark(benchmark::State &state)
+{
+    const Source &source = listSource();
+    StructuralPattern pattern("call($FIRST:list, $LITERAL:string, $NESTED:list, $LAST:list)");
+    TokenIndex index(source);
+    int64_t allocationsBefore = allocations;
+    for(auto _ : state) {
+        std::vector<StructuralPattern::Match> matches = state.range(0) ? pattern.find(source, index) : pattern.find(source);
+        for(auto &match : matches)
+            benchmark::DoNotOptimize(StructuralPattern::text(source, match.captures[0]));
+        benchmark::DoNotOptimize(matches.size());
+    }
+    countAllocations(state, allocationsBefore, state.iterations());
+}
+BENCHMARK(structuralPatternBenchmark)->DenseRange(0, 1)->Unit(benchmark::kMillisecond);
+
+static void iterateThroughOccurrencesBenchmark(benchmark::State &state)
+{
+    const Source &source = benchmarkedSource();
+    int64_t allocationsBefore = allocations;
+    for(auto _ : state) {
+        int found = 0;
+        source.iterateThroughOccurrences("std::vector<int>", [&] (int line, int, bool) -> int {
+            found++;
+            return line;
+        });
+        benchmark::DoNotOptimize(found);
+    }
+    state.SetBytesProcessed(state.iterations() * sourceSize(source));
+    countAllocations(state, allocationsBefore, state.iterations());
+}
+BENCHMARK(iterateThroughOccurrencesBenchmark)->Unit(benchmark::kMillisecond);
+
+static void iterateThroughOccurrencesParallelBenchmark(benchmark::State &state)
+{
+    const Source &source = benchmarkedSource();
+    for(auto _ : state) {
+        int found = 0;
+        source.iterateThroughOccurrencesParallel("std::vector<int>", [&] (int line, int, bool) -> int {
+            found++;
+            return line;
+        }, state.range(0));
+        benchmark::DoNotOptimize(found);
+    }
+    state.SetBytesProcessed(state.iterations() * sourceSize(source));
+}
+BENCHMARK(iterateThroughOccurrencesParallelBenchmark)->RangeMultiplier(2)->Range(1, 8)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+static void findNextLineContainingBenchmark(benchmark::State &state)
+{
+    const Source &source = benchmarkedSource();
+    for(auto _ : state) {
+        int found = state.range(0) == 0 ? source.findNextLineContaining("not in the corpus", 0)
+                : source.findNextLineContainingParallel("not in the corpus", 0, state.range(0));
+        benchmark::DoNotOptimize(found);
+    }
+    state.SetBytesProcessed(state.iterations() * sourceSize(source));
+}
+BENCHMARK(findNextLineContainingBenchmark)->Arg(0)->RangeMultiplier(2)->Range(1, 8)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+#if __cplusplus >= 202002L
+static void iterateThroughCompiledOccurrencesBenchmark(benchmark::State &state)
+{
+    const Source &source = benchmarkedSource();
+    int64_t allocationsBefore = allocations;
+    for(auto _ : state) {
+        int found = 0;
+        source.iterateThroughOccurrences<"std::vector<int>">([&] (int, int, bool) {
+            found++;
+        });
+        benchmark::DoNotOptimize(found);
+    }
+    state.SetBytesProcessed(state.iterations() * sourceSize(source));
+    countAllocations(state, allocationsBefore, state.iterations());
+}
+BENCHMARK(iterateThroughCompiledOccurrencesBenchmark)->Unit(benchmark::kMillisecond);
+#endif
+
+static void iterateThroughManyOccurrencesBenchmark(benchmark::State &state)
+{
+    const Source &source = benchmarkedSource();
+    PatternSet patterns({"std::vector<int>", "if(", "value1", "count(", "= {"});
+    int64_t allocationsBefore = allocations;
+    for(auto _ : state) {
+        int found = 0;
+        source.iterateThroughOccurrences(patterns, [&] (int, int line, int, bool) -> int {
+            found++;
+            return line;
+        });
+        benchmark::DoNotOptimize(found);
+    }
+    state.SetBytesProcessed(state.iterations() * sourceSize(source));
+    countAllocations(state, allocationsBefore, state.iterations());
+}
+BENCHMARK(iterateThroughManyOccurrencesBenchmark)->Unit(benchmark::kMillisecond);
+
+// Finds the end of every block from where it opens, the deeper it is nested the more often its text is passed
+static void findEndOfListBenchmark(benchmark::State &state)
+{
+    const Source &source = benchmarkedSource();
+    int64_t allocationsBefore = allocations;
+    for(auto _ : state) {
+        int64_t sum = 0;
+        for(int i = 0; i < (int)source.lines.size(); i++) {
+            const std::string &line = source.lines[i];
+            size_t end = line.find_last_not_of("\r");
+            if(end == std::string::npos || line[end] != '{') continue;
+            int endLine = i;
+            int endCharacter = end + 1;
+            source.findEndOfList(endLine, endCharacter, '{', '}', 1);
+            sum += endLine;
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetBytesProcessed(state.iterations() * sourceSize(source));
+    countAllocations(state, allocationsBefore, state.iterations());
+}
+BENCHMARK(findEndOfListBenchmark)->Unit(benchmark::kMillisecond);
+
+// Compares the source with a copy where every thousandth line is changed, both already cleaned
+static void mismatchesBenchmark(benchmark::State &state)
+{
+    const Source &source = benchmarkedSource();
+    Source first = Source::cleanAll(source);
+    Source second = first;
+    for(int i = 0; i < (int)second.lines.size(); i += 1000)
+        second.lines[i] += "changed";
+    int64_t allocationsBefore = allocations;
+    for(auto _ : state)
+        benchmark::DoNotOptimize(Source::mismatches(first, second, 20, false));
+    state.SetBytesProcessed(state.iterations() * sourceSize(source));
+    countAllocations(state, allocationsBefore, state.iterations());
+}
+BENCHMARK(mismatchesBenchmark)->Unit(benchmark::kMillisecond);
+
+static std::string benchmarkedFile()
+{
+    // Written once without a report and removed when the benchmarks end
+    static const struct WrittenFile {
+        std::string name = (std::filesystem::temp_directory_path() / "editing_utils_bench.cpp").string();
+        
+        WrittenFile()
+        {
+            benchmarkedSource().toFile(name, false, false);
+        }
+        
+        ~WrittenFile()
+        {
+            std::remove(name.c_str());
+        }
+    } file;
+    return file.name;
+}
+
+// The argument selects loading as a Source (0) or as a SourceView (1)
+static void fromFileBenchmark(benchmark::State &state)
+{
+    std::string fileName = benchmarkedFile();
+    int64_t allocationsBefore = allocations;
+    for(auto _ : state) {
+        if(state.range(0)) benchmark::DoNotOptimize(SourceView::fromFile(fileName));
+        else benchmark::DoNotOptimize(Source::fromFile(fileName));
+    }
+    state.SetLabel(state.range(0) ? "SourceView" : "Source");
+    state.SetBytesProcessed(state.iterations() * std::filesystem::file_size(fileName));
+    countAllocations(state, allocationsBefore, state.iterations());
+}
+BENCHMARK(fromFileBenchmark)->DenseRange(0, 1)->Unit(benchmark::kMillisecond);
+
+// The argument selects writing a file that has other contents (0) or one that already has the same contents and isn't written (1)
+static void toFileBenchmark(benchmark::State &state)
+{
+    const Source &source = benchmarkedSource();
+    std::string fileName = benchmarkedFile() + ".written";
+    source.toFile(fileName, false, false);
+    int64_t allocationsBefore = allocations;
+    int64_t uncounted = 0;
+    for(auto _ : state) {
+        if(!state.range(0)) {
+            state.PauseTiming();
+            int64_t changingStarted = allocations;
+            writeFile(fileName, "changed");
+            uncounted += allocations - changingStarted;
+            state.ResumeTiming();
+        }
+        source.toFile(fileName, false, false);
+    }
+    state.SetLabel(state.range(0) ? "unchanged" : "changed");
+    state.SetBytesProcessed(state.iterations() * sourceSize(source));
+    countAllocations(state, allocationsBefore + uncounted, state.iterations());
+    std::remove(fileName.c_str());
+}
+BENCHMARK(toFileBenchmark)->DenseRange(0, 1)->Unit(benchmark::kMillisecond);
+
+// Finds all occurrences of an identifier in the benchmarked file by loading and lexing it (0), by looking it up in a symbol index (1),
+// or updates the index when the file didn't change (2)
+static void symbolIndexBenchmark(benchmark::State &state)
+{
+    std::string fileName = benchmarkedFile();
+    std::string indexFileName = fileName + ".symbols";
+    SymbolIndex symbols(indexFileName);
+    symbols.update(std::vector<std::string>{fileName});
+    int64_t allocationsBefore = allocations;
+    for(auto _ : state) {
+        if(state.range(0) == 0) {
+            SourceView source = SourceView::fromFile(fileName);
+            TokenIndex index(source);
+            benchmark::DoNotOptimize(index.findIdentifier(source, "buffer42"));
+        }
+        else if(state.range(0) == 1) benchmark::DoNotOptimize(symbols.find("buffer42"));
+        else benchmark::DoNotOptimize(symbols.update(std::vector<std::string>{fileName}));
+    }
+    const char *labels[] = {"scan", "lookup", "unchanged update"};
+    state.SetLabel(labels[state.range(0)]);
+    countAllocations(state, allocationsBefore, state.iterations());
+    std::remove(indexFileName.c_str());
+}
+BENCHMARK(symbolIndexBenchmark)->DenseRange(0, 2)->Unit(benchmark::kMicrosecond);
+
+// Edits every hundredth line, the argument selects editing a Source (0) or a SourceView (1) whose edited lines go into its arena
+static void applyEditsBenchmark(benchmark::State &state)
+{
+    const Source &source = benchmarkedSource();
+    SourceView view(source.toString());
+    std::vector<SourceEdit> edits;
+    for(int i = 0; i < (int)source.lines.size(); i += 100)
+        edits.emplace_back(i, 0, i, 0, "/* edited */");
+    // Only the allocations made by the edits are counted, not those made by copying
+    int64_t allocationsBefore = allocations;
+    int64_t uncounted = 0;
+    for(auto _ : state) {
+        state.PauseTiming();
+        int64_t copyingStarted = allocations;
+        Source copy = source;
+        SourceView viewCopy = view;
+        uncounted += allocations - copyingStarted;
+        state.ResumeTiming();
+        if(state.range(0)) viewCopy.applyEdits(edits);
+        else copy.applyEdits(edits);
+        state.PauseTiming();
+        copy = Source();
+        viewCopy = SourceView();
+        state.ResumeTiming();
+    }
+    state.SetLabel(state.range(0) ? "SourceView" : "Source");
+    state.SetBytesProcessed(state.iterations() * sourceSize(source));
+    countAllocations(state, allocationsBefore + uncounted, state.iterations());
+}
+BENCHMARK(applyEditsBenchmark)->DenseRange(0, 1)->Unit(benchmark::kMillisecond);
+
+// A candidate rewrite editing every thousandth line of a copy of the source, with the copying measured too,
+// the argument selects copying a Source (0) or forking a SourceSnapshot (1)
+static void forkAndEditBenchmark(benchmark::State &state)
+{
+    const Source &source = benchmarkedSource();
+    SourceSnapshot snapshot(source);
+    std::vector<SourceEdit> edits;
+    for(int i = 0; i < (int)source.lines.size(); i += 1000)
+        edits.emplace_back(i, 0, i, 0, "/* edited */");
+    int64_t allocationsBefore = allocations;
+    for(auto _ : state) {
+        if(state.range(0)) {
+            SourceSnapshot fork = snapshot;
+            fork.applyEdits(edits);
+            benchmark::DoNotOptimize(fork);
+        } else {
+            Source copy = source;
+            copy.applyEdits(edits);
+            benchmark::DoNotOptimize(copy);
+        }
+    }
+    state.SetLabel(state.range(0) ? "SourceSnapshot" : "Source");
+    state.SetBytesProcessed(state.iterations() * sourceSize(source));
+    countAllocations(state, allocationsBefore, state.iterations());
+}
+BENCHMARK(forkAndEditBenchmark)->DenseRange(0, 1)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,437 @@
+#include "editing_utils.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <random>
+#include <tuple>
+
+// A differential fuzz target for the functions that have more than one implementation (parallel, streaming, view and arena versions,
+// pattern sets and so on). Every input is given to all the versions and their results must be the same, the process is aborted
+// with the input saved if they aren't. Reads past the ends of lines are caught by building it with sanitizers.
+// Every check is timed and the input with the longest time per byte is kept for each of them, to find quadratic behaviour.
+// The times are affected by anything else running, so the slowest inputs are worth timing again alone (and made longer).
+//
+// With libFuzzer: clang++ -std=c++17 -g -O1 -DEDITING_UTILS_LIBFUZZER -fsanitize=fuzzer,address,undefined editing_utils_fuzz.cpp
+// Alone: g++ -std=c++17 -g -O1 -fsanitize=address,undefined editing_utils_fuzz.cpp -pthread
+// and run it with the number of inputs to generate and a seed, or with names of files with inputs to run again.
+
+// The first byte selects the number of threads and the size of chunks, the next two a position in the text and the size of an edit.
+// The rest till the first line break is the expression sought, with spaces only between identifiers as it should have them,
+// and everything after it is the text.
+struct FuzzInput {
+    std::string sought;
+    std::string text;
+    int threads = 1;
+    int chunk = 1;
+    int position = 0;
+    int extent = 0;
+
+    static inline FuzzInput parse(const uint8_t *data, size_t size)
+    {
+        FuzzInput retval;
+        uint8_t header[3] = {};
+        std::copy(data, data + std::min<size_t>(size, 3), header);
+        retval.threads = 1 + (header[0] & 3);
+        retval.chunk = 1 + (header[0] >> 2);
+        retval.position = header[1];
+        retval.extent = header[2];
+        std::string_view rest(reinterpret_cast<const char*>(data) + std::min<size_t>(size, 3), size - std::min<size_t>(size, 3));
+        size_t lineEnd = std::min(rest.find('\n'), rest.size());
+        bool space = false;
+        for(char character : rest.substr(0, std::min<size_t>(lineEnd, 32))) {
+            if(character == ' ' || character == '\t' || character == '\r') {
+                space = true;
+                continue;
+            }
+            if(space && !retval.sought.empty() && Source::isValidIdentifierChar(retval.sought.back()) && Source::isValidIdentifierChar(character))
+                retval.sought.push_back(' ');
+            space = false;
+            retval.sought.push_back(character);
+        }
+        retval.text = std::string(rest.substr(std::min(lineEnd + 1, rest.size())));
+        return retval;
+    }
+
+    // A position in the source chosen by the input, the line is valid if there are any lines
+    inline std::pair<int, int> positionIn(const Source &source) const
+    {
+        if(source.lines.empty()) return {0, 0};
+        int line = position % source.lines.size();
+        return {line, (position * 31 + extent) % (source.lines[line].size() + 1)};
+    }
+};
+
+static const uint8_t *currentData = nullptr;
+static size_t currentSize = 0;
+
+static void saveInput(const std::string &fileName, std::string_view input)
+{
+    std::ofstream file(fileName, std::ios::binary);
+    file.write(input.data(), input.size());
+}
+
+static void require(bool condition, const char *check, const std::string &details = "")
+{
+    if(condition) return;
+    std::fprintf(stderr, "Versions of %s differ %s\n", check, details.c_str());
+    saveInput("fuzz-mismatch.txt", std::string_view(reinterpret_cast<const char*>(currentData), currentSize));
+    std::fprintf(stderr, "The input was saved as fuzz-mismatch.txt\n");
+    std::abort();
+}
+
+// The result, or nothing if it threw, so that versions that throw on the same inputs compare equal
+template <typename Function>
+static auto attempt(Function function) -> std::optional<decltype(function())>
+{
+    try {
+        return function();
+    } catch(std::exception &) {
+        return std::nullopt;
+    }
+}
+
+// Inputs shorter than this are dominated by the constant costs, they aren't considered for the slowest ones
+static const size_t timedMinimum = 256;
+
+struct Slowest {
+    double nanosecondsPerByte = 0;
+    std::string input;
+};
+
+static std::map<std::string, Slowest> &slowest()
+{
+    static std::map<std::string, Slowest> retval;
+    return retval;
+}
+
+template <typename Function>
+static void timed(const char *check, Function function)
+{
+    auto start = std::chrono::steady_clock::now();
+    function();
+    double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    if(currentSize < timedMinimum) return;
+    Slowest &worst = slowest()[check];
+    if(elapsed / currentSize <= worst.nanosecondsPerByte) return;
+    worst.nanosecondsPerByte = elapsed / currentSize;
+    worst.input.assign(reinterpret_cast<const char*>(currentData), currentSize);
+#ifdef EDITING_UTILS_LIBFUZZER
+    std::fprintf(stderr, "Slowest %s so far: %.1f ns per byte on %zu bytes\n", check, worst.nanosecondsPerByte, currentSize);
+#endif
+}
+
+// The kinds of all characters must be the same whether the text is lexed at once or in chunks.
+// The end of a raw string split between chunks is allowed to be reported as its contents, except the quote.
+static void checkLexer(const FuzzInput &input)
+{
+    const std::string &text = input.text;
+    auto lex = [&] (size_t chunk) {
+        std::vector<int> kinds(text.size(), -1);
+        Lexer::State state;
+        size_t position = 0;
+        auto mark = [&] (int start, int end, Lexer::Kind kind) {
+            for(int i = start; i < end; i++) kinds[position + i] = kind;
+            return true;
+        };
+        for(; position < text.size(); position += chunk)
+            Lexer::scan(text.data() + position, std::min(chunk, text.size() - position), state, mark);
+        position = text.size();
+        Lexer::scanLine(text.data() + position, 0, state, mark);
+        return kinds;
+    };
+    std::vector<int> whole;
+    std::vector<int> chunked;
+    timed("lexer", [&] { whole = lex(std::max<size_t>(text.size(), 1)); });
+    timed("lexer", [&] { chunked = lex(input.chunk); });
+    for(size_t i = 0; i < text.size(); i++) {
+        require(whole[i] >= 0, "lexer", "(a character was not reported)");
+        require(chunked[i] == whole[i] || (whole[i] == Lexer::StringEnd && chunked[i] == Lexer::String), "lexer", "(when lexed in chunks)");
+    }
+}
+
+static void checkOccurrences(const FuzzInput &input, const Source &source)
+{
+    if(input.sought.empty()) return;
+    typedef std::tuple<int, int, bool> Found;
+    std::vector<Found> sequential;
+    std::vector<Found> parallel;
+    timed("occurrences", [&] {
+        source.iterateThroughOccurrences(input.sought, [&] (int line, int character, bool oneLine) {
+            sequential.emplace_back(line, character, oneLine);
+            return line;
+        });
+    });
+    timed("occurrences", [&] {
+        source.iterateThroughOccurrencesParallel(input.sought, [&] (int line, int character, bool oneLine) {
+            parallel.emplace_back(line, character, oneLine);
+            return line;
+        }, input.threads);
+    });
+    require(sequential == parallel, "iterateThroughOccurrences", "(in parallel)");
+
+    // A set of one pattern finds the same occurrences, reported where they end. It keeps whitespace according to
+    // each character and the single pattern version according to the start, so they differ if a literal can end inside.
+    if(input.sought.find_first_of("\"'", 1) == std::string::npos) {
+        std::vector<std::pair<int, int>> starts;
+        std::vector<std::pair<int, int>> patternStarts;
+        source.findOccurrences(input.sought, 0, source.lines.size(), [&] (const Source::Occurrence &found) {
+            starts.emplace_back(found.startLine, found.startCharacter);
+        });
+        PatternSet patterns({input.sought});
+        timed("occurrences", [&] {
+            source.findOccurrences(patterns, [&] (const Source::Occurrence &found) {
+                patternStarts.emplace_back(found.startLine, found.startCharacter);
+                return found.line;
+            });
+        });
+        std::sort(patternStarts.begin(), patternStarts.end());
+        require(starts == patternStarts, "iterateThroughOccurrences", "(with a pattern set)");
+    }
+
+#if __cplusplus >= 202002L
+    auto fixed = [&] <FixedPattern Pattern> () {
+        std::vector<Found> expected;
+        std::vector<Found> found;
+        source.iterateThroughOccurrences(std::string(Pattern.text, Pattern.size), [&] (int line, int character, bool oneLine) {
+            expected.emplace_back(line, character, oneLine);
+            return line;
+        });
+        source.iterateThroughOccurrences<Pattern>([&] (int line, int character, bool oneLine) {
+            found.emplace_back(line, character, oneLine);
+        });
+        require(expected == found, "iterateThroughOccurrences", "(with a fixed pattern)");
+    };
+    fixed.template operator()<"a(b">();
+    fixed.template operator()<"<int>">();
+    fixed.template operator()<"\"a">();
+#endif
+
+    // Without holes, a structural pattern finds the same token sequences as the token index
+    if(input.sought.find('$') == std::string::npos) {
+        TokenIndex index(source);
+        typedef std::vector<std::pair<int, int>> Sequences;
+        std::optional<Sequences> indexed = attempt([&] {
+            Sequences retval;
+            for(const TokenIndex::Match &match : index.find(source, input.sought))
+                retval.emplace_back(match.first, match.last);
+            std::sort(retval.begin(), retval.end());
+            return retval;
+        });
+        std::optional<Sequences> structural;
+        timed("occurrences", [&] {
+            structural = attempt([&] {
+                Sequences retval;
+                for(const StructuralPattern::Match &match : StructuralPattern(input.sought).find(source, index))
+                    retval.emplace_back(match.whole.first, match.whole.last);
+                return retval;
+            });
+        });
+        require(indexed == structural || (indexed && indexed->empty() && !structural), "StructuralPattern", "(without holes)");
+    }
+
+    int line = input.positionIn(source).first;
+    int next = source.findNextLineContaining(input.sought, line);
+    int nextParallel = 0;
+    timed("occurrences", [&] { nextParallel = source.findNextLineContainingParallel(input.sought, line, input.threads); });
+    require(next == nextParallel, "findNextLineContaining", "(in parallel)");
+}
+
+static void checkNormalising(const FuzzInput &input, const Source &source)
+{
+    std::string expected;
+    timed("normalise", [&] { expected = Source::cleanAll(source).toString(true); });
+    std::string streamed;
+    timed("normalise", [&] {
+        StreamingNormaliser normaliser([&] (std::string_view part) { streamed.append(part); }, input.chunk);
+        for(size_t i = 0; i < input.text.size(); i += input.chunk)
+            normaliser.feed(std::string_view(input.text).substr(i, input.chunk));
+        normaliser.finish();
+    });
+    require(streamed == expected, "cleanAll", "(streamed)");
+    timed("normalise", [&] {
+        for(const std::string &line : source.lines)
+            Source::normaliseLine(line);
+    });
+
+    // The first difference from the text with a character removed
+    std::string changed = input.text;
+    if(!changed.empty()) changed.erase(input.position % changed.size(), 1);
+    std::string first = StreamingNormaliser::normalise(input.text);
+    std::string second = StreamingNormaliser::normalise(changed);
+    long long expectedDifference = -1;
+    if(first != second) expectedDifference = std::mismatch(first.begin(), first.end(), second.begin(), second.end()).first - first.begin();
+    long long difference = 0;
+    timed("compare", [&] {
+        std::stringstream firstStream(input.text);
+        std::stringstream secondStream(changed);
+        difference = StreamingComparator::firstDifference(firstStream, secondStream, input.chunk);
+    });
+    require(difference == expectedDifference, "StreamingComparator");
+}
+
+static void checkLists(const FuzzInput &input, const Source &source, TextArena &arena)
+{
+    for(const std::string &line : source.lines) {
+        require(Source::getStringLiteral(line) == Source::getStringLiteral(std::string_view(line), arena), "getStringLiteral", "(in the arena)");
+        require(Source::removeConst(line) == Source::removeConst(std::string_view(line), arena), "removeConst", "(in the arena)");
+        require(Source::removeReference(line) == Source::removeReference(std::string_view(line), arena), "removeReference", "(in the arena)");
+    }
+    if(source.lines.empty()) return;
+    auto [line, character] = input.positionIn(source);
+    std::optional<std::vector<std::string>> list;
+    std::optional<std::vector<std::string>> listViews;
+    timed("lists", [&] { list = attempt([&] { return source.parseList(line, character, ',', ')', '('); }); });
+    timed("lists", [&] {
+        listViews = attempt([&] {
+            std::vector<std::string_view> views;
+            source.parseList(std::back_inserter(views), arena, line, character, ',', ')', '(');
+            return std::vector<std::string>(views.begin(), views.end());
+        });
+    });
+    require(list == listViews, "parseList", "(into views)");
+
+    std::optional<std::string> tillEnd;
+    std::optional<std::string> tillEndView;
+    timed("lists", [&] { tillEnd = attempt([&] { return source.getTillEndOfList(line, character, '(', ')', 1); }); });
+    timed("lists", [&] { tillEndView = attempt([&] { return std::string(source.getTillEndOfList(arena, line, character, '(', ')', 1)); }); });
+    require(tillEnd == tillEndView, "getTillEndOfList", "(in the arena)");
+
+    std::optional<std::string> assigned = attempt([&] { return source.whatIsItAssignedTo(line, character); });
+    std::optional<std::string> assignedView = attempt([&] { return std::string(source.whatIsItAssignedToView(line, character)); });
+    require(assigned == assignedView, "whatIsItAssignedTo", "(as a view)");
+}
+
+// The sought expression replaces a part of the text chosen by the input
+static void checkEdits(const FuzzInput &input, const Source &source)
+{
+    if(source.lines.empty()) return;
+    auto [line, character] = input.positionIn(source);
+    int endLine = std::min<int>(line + input.extent % 2, source.lines.size() - 1);
+    int endSize = source.lines[endLine].size();
+    int endCharacter = (endLine == line) ? character + input.extent % (endSize - character + 1) : input.extent % (endSize + 1);
+    std::vector<SourceEdit> edits{SourceEdit(line, character, endLine, endCharacter, input.sought)};
+
+    Source edited = source;
+    timed("edits", [&] { edited.applyEdits(edits); });
+    std::string expected = edited.toString();
+    require(source.withEdits(edits).toString() == expected, "applyEdits", "(into a copy)");
+    SourceView view(input.text);
+    timed("edits", [&] { view.applyEdits(edits); });
+    require(view.toString() == expected, "applyEdits", "(on views)");
+    EditBuffer buffer;
+    buffer.replace(line, character, endLine, endCharacter, input.sought);
+    require(buffer.appliedTo(SourceView(input.text)).toString() == expected, "applyEdits", "(from an edit buffer)");
+    // A fork of a snapshot edited twice, the second time also after the lines of the first edit, must leave the snapshot as it was
+    SourceSnapshot snapshot(source);
+    SourceSnapshot fork = snapshot;
+    timed("edits", [&] { fork.applyEdits(edits); });
+    require(fork.view().toString() == expected, "applyEdits", "(on a snapshot)");
+    std::vector<SourceEdit> furtherEdits{SourceEdit(0, 0, 0, 0, input.sought)};
+    if(fork.size() > 1) furtherEdits.push_back(SourceEdit(fork.size() - 1, fork[fork.size() - 1].size(), fork.size() - 1, fork[fork.size() - 1].size(), "\n;"));
+    fork.applyEdits(furtherEdits);
+    require(fork.toSource().toString() == edited.withEdits(furtherEdits).toString() && snapshot.toSource().toString() == source.toString(),
+            "applyEdits", "(on a fork of a snapshot)");
+
+    // The line of the edit is replaced by the lines it became in the index
+    TokenIndex index(source);
+    BracketTable brackets(index);
+    Source replaced = source;
+    std::vector<std::string> inserted = Source(edited.lines[line] + "\n" + input.sought).lines;
+    replaced.lines.erase(replaced.lines.begin() + line);
+    replaced.lines.insert(replaced.lines.begin() + line, inserted.begin(), inserted.end());
+    timed("tokens", [&] {
+        index.update(replaced, line, 1, inserted.size());
+        brackets.invalidate(line);
+    });
+    TokenIndex fresh(replaced);
+    BracketTable freshBrackets(fresh);
+    require(index.tokens.size() == fresh.tokens.size() && index.lineStarts == fresh.lineStarts && index.lineStates == fresh.lineStates,
+            "TokenIndex", "(updated)");
+    for(size_t i = 0; i < fresh.tokens.size(); i++) {
+        const TokenIndex::Token &token = index.tokens[i];
+        const TokenIndex::Token &freshToken = fresh.tokens[i];
+        require(token.line == freshToken.line && token.column == freshToken.column && token.length == freshToken.length
+                && token.kind == freshToken.kind && token.hash == freshToken.hash, "TokenIndex", "(updated)");
+        require(brackets.partner(i) == freshBrackets.partner(i) && brackets.enclosing(i) == freshBrackets.enclosing(i), "BracketTable", "(updated)");
+    }
+}
+
+static int runInput(const uint8_t *data, size_t size)
+{
+    currentData = data;
+    currentSize = size;
+    FuzzInput input = FuzzInput::parse(data, size);
+    Source source(input.text);
+    TextArena arena(64);
+    checkLexer(input);
+    checkOccurrences(input, source);
+    checkNormalising(input, source);
+    checkLists(input, source, arena);
+    checkEdits(input, source);
+    return 0;
+}
+
+#ifdef EDITING_UTILS_LIBFUZZER
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    return runInput(data, size);
+}
+#else
+// C++ like text made of pieces that are likely to confuse the functions, sometimes with one of them repeated many times
+static std::string generatedInput(std::mt19937 &random)
+{
+    static const char *pieces[] = {"a", "b", "x_1", " ", "  ", "\t", "\n", "\r\n", "(", ")", ",", ";", "=", "<", ">", "{", "}", "[", "]",
+                                   "&", " &", "const ", "int", "\"", "'", "\\", "/", "*", "//", "/*", "*/", "R\"(", ")\"", "R\"x(", ")x\"",
+                                   "u8", "1'0", "a(b", "<int>", "\"a"};
+    const int pieceCount = sizeof(pieces) / sizeof(*pieces);
+    auto pick = [&] (int count) { return int(random() % count); };
+    std::string retval;
+    for(int i = 0; i < 3; i++)
+        retval.push_back(char(pick(256)));
+    int soughtPieces = 1 + pick(3);
+    for(int i = 0; i < soughtPieces; i++) {
+        const char *piece = pieces[pick(pieceCount)];
+        if(!std::strchr(piece, '\n')) retval += piece;
+    }
+    retval.push_back('\n');
+    int parts = pick(4) ? pick(60) : 1 + pick(4);
+    for(int i = 0; i < parts; i++) {
+        const char *piece = pieces[pick(pieceCount)];
+        int repeats = pick(8) ? 1 : pick(2000);
+        for(int j = 0; j < repeats; j++)
+            retval += piece;
+    }
+    return retval;
+}
+
+int main(int argc, char **argv)
+{
+    bool generating = argc < 2 || std::all_of(argv[1], argv[1] + std::strlen(argv[1]), [] (char character) { return std::isdigit(character); });
+    if(generating) {
+        int count = (argc > 1) ? std::atoi(argv[1]) : 10000;
+        std::mt19937 random((argc > 2) ? std::atoi(argv[2]) : 1);
+        for(int i = 0; i < count; i++) {
+            std::string generated = generatedInput(random);
+            runInput(reinterpret_cast<const uint8_t*>(generated.data()), generated.size());
+        }
+        std::printf("%d inputs gave the same results in all versions.\n", count);
+    }
+    else {
+        for(int i = 1; i < argc; i++) {
+            std::ifstream file(argv[i], std::ios::binary);
+            std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            runInput(reinterpret_cast<const uint8_t*>(contents.data()), contents.size());
+        }
+        std::printf("%d inputs gave the same results in all versions.\n", argc - 1);
+    }
+    for(auto &[check, worst] : slowest()) {
+        std::string fileName = "fuzz-slowest-" + check + ".txt";
+        std::printf("Slowest %s: %.1f ns per byte on %zu bytes, saved as %s\n", check.c_str(), worst.nanosecondsPerByte, worst.input.size(),
+                    fileName.c_str());
+        saveInput(fileName, worst.input);
+    }
+    return 0;
+}
+#endif
@@ -1,4 +1,5 @@
 #include "editing_utils.h"
+#include "editing_utils_batch.h"
 
 class AllAssignmentsPassed {
     bool value = true;
@@ -29,7 +30,12 @@ bool makeTest(T real, T expected, std::string problem)
 inline bool editingUtilsTest()
 {
     AllAssignmentsPassed success;
+    // Files written by the tests go into a new directory of their own, so that nothing of the caller's is touched
+    std::filesystem::path testDirectory;
     try {
+        do testDirectory = std::filesystem::temp_directory_path() / ("editing_utils_test_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+        while(!std::filesystem::create_directory(testDirectory));
+        
         // isValidIdentifierChar
         success = makeTest(Source::isValidIdentifierChar('a'), true, "a should be valid");
         success = makeTest(Source::isValidIdentifierChar('y'), true, "y should be valid");
@@ -40,8 +46,91 @@ inline bool editingUtilsTest()
         success = makeTest(Source::isValidIdentifierChar('^'), false, "^ should be invalid");
         success = makeTest(Source::isValidIdentifierChar('\n'), false, "newline should be invalid");
         success = makeTest(Source::isValidIdentifierChar('?'), false, "? should be invalid");
+        static_assert(Source::isValidIdentifierChar('$') && !Source::isValidIdentifierChar('<'), "isValidIdentifierChar isn't usable while compiling");
         //std::cout << "isValidIdentifierChar() works." << std::endl;
         
+        // CharacterScanner
+        std::string scannedText = " \tint a_$9 = \"/* x */\"; // \r\xe9z@[`{/Z0 ";
+        for(CharacterScanner::Kernel kernel : {CharacterScanner::Scalar, CharacterScanner::SSE2, CharacterScanner::AVX2}) {
+            if(!CharacterScanner::supported(kernel)) continue;
+            CharacterScanner::Kernel previousKernel = CharacterScanner::kernel();
+            CharacterScanner::setKernel(kernel);
+            for(int offset = 0; offset < (int)scannedText.size(); offset++) {
+                CharacterScanner::Masks masks = CharacterScanner::classify(scannedText.data() + offset, scannedText.size() - offset);
+                for(int i = 0; i + offset < (int)scannedText.size() && i < CharacterScanner::blockSize; i++) {
+                    char scanned = scannedText[offset + i];
+                    success = makeTest<bool>((masks.identifier >> i) & 1, Source::isValidIdentifierChar(scanned), " identifier characters classified wrongly");
+                    success = makeTest<bool>((masks.whitespace >> i) & 1, scanned == ' ' || scanned == '\t' || scanned == '\r',
+                                             " whitespace characters classified wrongly");
+                    success = makeTest<bool>((masks.quote >> i) & 1, scanned == '"', " quotes classified wrongly");
+                    success = makeTest<bool>((masks.slash >> i) & 1, scanned == '/', " slashes classified wrongly");
+                }
+            }
+            success = makeTest<int>(CharacterScanner::findNonWhitespace(scannedText.data(), scannedText.size()), 2, " first non-whitespace not found");
+            success = makeTest<int>(CharacterScanner::findQuoteOrSlash(scannedText.data(), scannedText.size(), 15), 20, " slash not found");
+            // Every size and start, so that whole blocks, the overlapping last block and short texts are all searched
+            std::string searchedText = scannedText + "'\n" + scannedText;
+            for(int size = 0; size <= (int)searchedText.size(); size++) {
+                std::string_view searched(searchedText.data(), size);
+                for(int from = 0; from <= size; from++) {
+                    success = makeTest<size_t>(CharacterScanner::findQuoteApostropheSlashOrNewline(searched.data(), size, from),
+                                               std::min<size_t>(searched.find_first_of("\"'/\n", from), size), " special character not found");
+                }
+                std::vector<int> visited;
+                CharacterScanner::forEachOf(searched.data(), size, ' ', '\t', '\r', ' ', [&] (int i) {
+                    visited.push_back(i);
+                    return true;
+                });
+                std::vector<int> whitespace;
+                for(size_t i = searched.find_first_of(" \t\r"); i != std::string_view::npos; i = searched.find_first_of(" \t\r", i + 1))
+                    whitespace.push_back(i);
+                success = makeTest(visited == whitespace, true, " whitespace characters visited wrongly");
+            }
+            CharacterScanner::setKernel(previousKernel);
+        }
+        //std::cout << "CharacterScanner works." << std::endl;
+        
+        // Lexer
+        // The kind of every character as a digit, the text is lexed in chunks of the given size
+        auto lexedKinds = [] (const std::string &text, int chunk) {
+            std::string retval(text.size(), '?');
+            Lexer::State state;
+            for(int offset = 0; offset < (int)text.size(); offset += chunk) {
+                Lexer::scan(text.data() + offset, std::min<int>(chunk, text.size() - offset), state, [&] (int start, int end, Lexer::Kind kind) {
+                    for(int i = offset + start; i < offset + end; i++)
+                        retval[i] = '0' + kind;
+                    return true;
+                });
+            }
+            if(state.mode == Lexer::AfterSlash) retval.back() = '0' + Lexer::Code;
+            return retval;
+        };
+        std::vector<std::pair<std::string, std::string>> lexedTexts = {
+            {"s = R\"ab(a)\" )ab\" + u8R\"(x)\" + BR\"(y)\";", "000002222333344440000002234400000233340"},
+            {"R\"aaaaaaaaaaaaaaaaa(x)\" R\"a b(x)\" R\"a)\";", "0222222222222222223333400223333340022340"},
+            {"c = '\\'' + u8'\"' + \"a\\\"b\\\\\" + x;", "00005667000005670002333333400000"},
+            {"n = 1'000'000 + 0x1'F + a'b';", "00000000000000000000000005670"},
+            {"a /* b \"c\"\n*/ d // e \"f\ng / h / / i", "00111111111110001111111000000000000"},
+            {"r = R\"x(\n)\"\n)x\" \"a\\\nb\" 'c", "0000022233334440233334056"}
+        };
+        for(CharacterScanner::Kernel kernel : {CharacterScanner::Scalar, CharacterScanner::SSE2, CharacterScanner::AVX2}) {
+            if(!CharacterScanner::supported(kernel)) continue;
+            CharacterScanner::Kernel previousKernel = CharacterScanner::kernel();
+            CharacterScanner::setKernel(kernel);
+            for(const auto &[text, kinds] : lexedTexts) {
+                success = makeTest<std::string>(lexedKinds(text, text.size()), kinds, " wrong kinds of characters lexed");
+                for(int chunk = 1; chunk < (int)text.size(); chunk++) {
+                    // The closing delimiter of a raw string split between chunks is a part of the string
+                    std::string chunked = lexedKinds(text, chunk);
+                    for(int i = 0; i < (int)chunked.size(); i++)
+                        if(kinds[i] == '0' + Lexer::StringEnd && chunked[i] == '0' + Lexer::String) chunked[i] = kinds[i];
+                    success = makeTest<std::string>(chunked, kinds, " lexed differently in chunks of " + std::to_string(chunk));
+                }
+            }
+            CharacterScanner::setKernel(previousKernel);
+        }
+        //std::cout << "Lexer works." << std::endl;
+        
         // skipWhitespace
         Source testingSource1("   int a = 8;\n\r  \tint b = 5;\n   \t  \n\r    \n   int c = 22;");
         success = makeTest<int>(testingSource1.skipWhitespace(0, 0), 3, " basic test of skipping whitespace failed");
@@ -56,6 +145,10 @@ inline bool editingUtilsTest()
         // findNextLineContaining
         success = makeTest<int>(testingSource1.findNextLineContaining("int", 0), 0, " basic test of finding next line with something failed");
         success = makeTest<int>(testingSource1.findNextLineContaining("int", 2), 4, " larger test of finding next line with something failed");
+        for(int threads = 1; threads <= 4; threads++) {
+            success = makeTest<int>(testingSource1.findNextLineContainingParallel("int", 2, threads), 4, " finding next line with something in parallel failed");
+            success = makeTest<int>(testingSource1.findNextLineContainingParallel("not there", 1, threads), testingSource1.lines.size(), " finding next line with nothing in parallel failed");
+        }
         //std::cout << "findNextLineContaining() works." << std::endl;
         
         // goBackLine
@@ -82,7 +175,117 @@ inline bool editingUtilsTest()
             return line + 1;
         });
         success = makeTest<int>(count, 3, " more advanced test of iterating through occurrences failed");
+        std::string edgesFound;
+        Source testingSource4e("x = \"\n(y;\nf(a)");
+        for(const char *sought : {"\"(", "a)"}) {
+            testingSource4e.iterateThroughOccurrences(sought, [&](int line, int character, bool oneLine) -> int {
+                edgesFound += std::to_string(line) + ":" + std::to_string(character) + (oneLine ? " " : "+ ");
+                return line;
+            });
+        }
+        success = makeTest<std::string>(edgesFound, "1:1+ 2:4 ", " occurrences after a literal's line end or at the end of the text not found");
+        const std::string widenedText = "int a = 0; int b = 0; int c = 0; int d = 0;\nint e;";
+        const std::string widenedExpected = "unsigned long long a = 0; unsigned long long b = 0; unsigned long long c = 0; unsigned long long d = 0;\n"
+                "unsigned long long e;";
+        Source testingSource4w(widenedText);
+        testingSource4w.iterateThroughOccurrences("int ", [&](int line, int character, bool) -> int {
+            testingSource4w.lines[line].replace(character - 4, 3, "unsigned long long");
+            return line;
+        });
+        success = makeTest<std::string>(testingSource4w.toString(), widenedExpected, " line reallocated by the callback not searched further");
         //std::cout << "iterateThroughOccurrences() works." << std::endl;
+        std::string sequentialFound;
+        std::string parallelFound;
+        Source testingSource4p("a = b<\n  int> c;\n\"b<int>\nb<int>\" b <int>\nx;\nb<int>\n\n\"b<int>\" b<int>\nb<int>");
+        testingSource4p.iterateThroughOccurrences("b<int>", [&](int line, int character, bool oneLine) -> int {
+            sequentialFound += std::to_string(line) + ":" + std::to_string(character) + (oneLine ? " " : "+ ");
+            return line;
+        });
+        for(int threads = 1; threads <= 8; threads++) {
+            parallelFound.clear();
+            testingSource4p.iterateThroughOccurrencesParallel("b<int>", [&](int line, int character, bool oneLine) -> int {
+                parallelFound += std::to_string(line) + ":" + std::to_string(character) + (oneLine ? " " : "+ ");
+                return line;
+            }, threads);
+            success = makeTest<std::string>(parallelFound, sequentialFound, " occurrences found in parallel differ with " + std::to_string(threads) + " threads");
+        }
+        //std::cout << "iterateThroughOccurrencesParallel() works." << std::endl;
+#if __cplusplus >= 202002L
+        count = 0;
+        testingSource4.iterateThroughOccurrences<"unique_ptr<int>">([&](int line, int, bool) {
+            count += line;
+        });
+        success = makeTest<int>(count, 3, " iterating through occurrences of a pattern known while compiling failed");
+        std::string runtimeFound;
+        std::string compiledFound;
+        Source testingSource4c("a = b<\n  int> c;\n\"b<int>\" b <int>");
+        testingSource4c.iterateThroughOccurrences("b<int>", [&](int line, int character, bool oneLine) -> int {
+            runtimeFound += std::to_string(line) + ":" + std::to_string(character) + (oneLine ? " " : "+ ");
+            return line;
+        });
+        testingSource4c.iterateThroughOccurrences<"b<int>">([&](int line, int character, bool oneLine) {
+            compiledFound += std::to_string(line) + ":" + std::to_string(character) + (oneLine ? " " : "+ ");
+        });
+        success = makeTest<std::string>(compiledFound, runtimeFound, " pattern known while compiling found elsewhere");
+        Source testingSource4cw(widenedText);
+        testingSource4cw.iterateThroughOccurrences<"int ">([&](int line, int character, bool) {
+            testingSource4cw.lines[line].replace(character - 4, 3, "unsigned long long");
+        });
+        success = makeTest<std::string>(testingSource4cw.toString(), widenedExpected, " line reallocated by the callback not searched further with a pattern known while compiling");
+        //std::cout << "iterateThroughOccurrences() with a pattern known while compiling works." << std::endl;
+#endif
+        
+        // iterateThroughOccurrences with many patterns
+        PatternSet testingPatterns({"unique_ptr<int>", "int", "ptr<", "b;"});
+        std::vector<int> patternCounts(testingPatterns.patterns.size(), 0);
+        std::string foundAt;
+        testingSource4.iterateThroughOccurrences(testingPatterns, [&](int pattern, int line, int character, bool) -> int {
+            patternCounts[pattern]++;
+            foundAt += std::to_string(line) + ":" + std::to_string(character) + " ";
+            return line;
+        });
+        success = makeTest<int>(patternCounts[0], 2, " finding multiple patterns missed a long pattern");
+        success = makeTest<int>(patternCounts[1], 3, " finding multiple patterns missed a pattern contained in another one");
+        success = makeTest<int>(patternCounts[2], 2, " finding multiple patterns missed a pattern in the middle of another one");
+        success = makeTest<int>(patternCounts[3], 1, " finding multiple patterns missed a pattern at the end of a line");
+        success = makeTest<std::string>(foundAt, "0:3 1:12 1:15 1:17 1:19 2:16 2:19 2:21 ", " multiple patterns found in wrong places");
+        Source testingSource4b("int a = foo\n  (b);\n\"a ( b\" fo\no(b);\nx = a (b);\nfoo\n\n(b);");
+        count = 0;
+        testingSource4b.iterateThroughOccurrences(PatternSet({"foo(b)", "a(b"}), [&](int, int line, int, bool oneLine) -> int {
+            count += oneLine ? 1 : 10;
+            return line;
+        });
+        success = makeTest<int>(count, 11, " finding multiple patterns doesn't respect line breaks and literals");
+        Source testingSource4bw(widenedText);
+        testingSource4bw.iterateThroughOccurrences(PatternSet({"int "}), [&](int, int line, int character, bool) -> int {
+            testingSource4bw.lines[line].replace(character - 4, 3, "unsigned long long");
+            return line;
+        });
+        success = makeTest<std::string>(testingSource4bw.toString(), widenedExpected, " line reallocated by the callback not searched further with many patterns");
+        Source testingSource4bb("foo(a); foo(b);\nfoo(c);");
+        for(int back : {1, 100}) {
+            count = 0;
+            testingSource4bb.iterateThroughOccurrences(PatternSet({"foo("}), [&](int, int line, int, bool) -> int {
+                count++;
+                return line - back;
+            });
+            success = makeTest<int>(count, 3, " returning an earlier line from the callback changed the search with many patterns");
+        }
+        count = 0;
+        testingSource4bb.iterateThroughOccurrences(PatternSet({"foo("}), [&](int, int, int, bool) -> int {
+            count++;
+            return 100;
+        });
+        success = makeTest<int>(count, 1, " returning a line after the end from the callback didn't end the search with many patterns");
+        bool noPatternsRejected = false;
+        try {
+            PatternSet(std::vector<std::string>{});
+        }
+        catch(std::runtime_error &) {
+            noPatternsRejected = true;
+        }
+        success = makeTest<bool>(noPatternsRejected, true, " empty list of patterns accepted");
+        //std::cout << "iterateThroughOccurrences() with many patterns works." << std::endl;
         
         // whatIsItAssignedTo
         success = makeTest<std::string>(testingSource3.whatIsItAssignedTo(0, 8), "a", " basic test of checking what is assigned failed");
@@ -134,6 +337,32 @@ inline bool editingUtilsTest()
         success = makeTest<std::string>(Source::removeReference("  blablabla "), "  blablabla ", "finding & where it is not");
         success = makeTest<std::string>(Source::removeReference("  const std::string& line;"), "  const std::string line;", "reference not removed");
         //std::cout << "removeReference() works." << std::endl;
+
+        // Variants with views and TextArena
+        TextArena arena(8);
+        Source testingSource12("call(first, \"a,\\\n b\", g(x, y),\n   last)");
+        std::vector<std::string_view> elements;
+        testingSource12.parseList(std::back_inserter(elements), arena, 0, 5, ',', ')', '(');
+        success = makeTest<int>(elements.size(), 4, " parsing a list into views found a wrong number of elements");
+        success = makeTest<bool>(elements[0].data() == testingSource12.lines[0].data() + 5, true, " element on one line not given as a view into it");
+        success = makeTest<std::string>(std::string(elements[1]), "\"a,\\\n b\"", " element spanning lines not joined");
+        success = makeTest<std::string>(std::string(elements[2]) + "|" + std::string(elements[3]), "g(x, y)|last", " elements parsed into views wrongly");
+        success = makeTest<std::string>(std::string(testingSource12.getTillEndOfList(arena, 0, 4, '(', ')')), testingSource12.getTillEndOfList(0, 4, '(', ')'),
+                                        " getting a list spanning lines with an arena differs");
+        success = makeTest<std::string>(std::string(Source::getStringLiteral("a = \"ab\" + \"cd\" + \"e\";", arena)), "abcde", " literals not joined in the arena");
+        std::string unchanged = "  std::string line;";
+        success = makeTest<bool>(Source::removeConst(std::string_view(unchanged), arena).data() == unchanged.data(), true, " copied without any const");
+        success = makeTest<std::string>(std::string(Source::removeConst(std::string_view("  const std::string& line;"), arena)), "  std::string& line;",
+                                        " const not removed into the arena");
+        success = makeTest<std::string>(std::string(Source::removeReference(std::string_view("  const std::string& line;"), arena)), "  const std::string line;",
+                                        " reference not removed into the arena");
+        success = makeTest<std::string>(std::string(testingSource5.whatIsItAssignedToView(1, 2)), "ahoy",
+                                        " finding the assigned variable as a view differs");
+        size_t arenaCapacity = arena.capacity();
+        arena.clear();
+        testingSource12.parseList(std::back_inserter(elements), arena, 0, 5, ',', ')', '(');
+        success = makeTest<int>(arena.capacity(), arenaCapacity, " arena not reused after clearing");
+        //std::cout << "Variants with views work." << std::endl;
         
         // normaliseLine
         success = makeTest<std::string>(Source::normaliseLine(" \t \r "), "", "not clearing enough whitespaces");
@@ -157,12 +386,472 @@ inline bool editingUtilsTest()
         success = makeTest<int>(Source::mismatches(Source::cleanAll(Source("ahahaha mwahaha")), Source::cleanAll(Source("aharaha mwaharaha")), 3, false), 2,
                                 " more advanced test of mismatches failed");
         //std::cout << "Mismatches happen as they should. mismatches() works." << std::endl;
+        success = makeTest<int>(Source::mismatches(Source("int a;\nint b;\nint c;\nint d;"), Source("int a;\nint c;\nint d;\nint e;"), 20, false), 2,
+                                " mismatches with whole lines missing or added failed");
+        
+        // diff
+        Source testingSource10("int a;\n\n// comment\nint b;\nint c; /* x */\nint d;\n");
+        Source testingSource11("int a;\n  int b;\nint x;\nint y;\nint d;\nint e;");
+        std::vector<DiffHunk> hunks = Source::diff(testingSource10, testingSource11);
+        success = makeTest<int>(hunks.size(), 2, " wrong number of differences found");
+        success = makeTest<std::string>(std::to_string(hunks[0].firstStart) + "-" + std::to_string(hunks[0].firstEnd) + " " + std::to_string(hunks[0].secondStart)
+                                        + "-" + std::to_string(hunks[0].secondEnd), "4-5 2-4", " difference not found at the original lines");
+        success = makeTest<std::string>(std::to_string(hunks[1].firstStart) + "-" + std::to_string(hunks[1].firstEnd) + " " + std::to_string(hunks[1].secondStart)
+                                        + "-" + std::to_string(hunks[1].secondEnd), "6-6 5-6", " added line not found at the original lines");
+        std::vector<DiffHunk> parallelHunks = Source::diff(testingSource10, testingSource11, 3);
+        success = makeTest<int>(parallelHunks.size(), 2, " parallel comparison found a different number of differences");
+        success = makeTest<int>(parallelHunks[1].secondStart, 5, " parallel comparison found a difference elsewhere");
+        //std::cout << "diff() works." << std::endl;
+
+        // StreamingNormaliser and StreamingComparator
+        std::string streamedText = " abuk /* this is \n \tessential */ papek; // \"x\n  int  b = \"a  /* b\";\r\nint\tc;/*/ int d;";
+        std::string streamed;
+        StreamingNormaliser normaliser([&] (std::string_view piece) { streamed.append(piece); }, 4);
+        for(char character : streamedText)
+            normaliser.feed(std::string_view(&character, 1));
+        normaliser.finish();
+        success = makeTest<std::string>(streamed, Source::cleanAll(Source(streamedText)).toString(true), " streaming normalisation differs from cleanAll");
+        std::stringstream streamedFirst(streamedText);
+        std::stringstream streamedSecond("abuk /**/papek;\n intb =\"a  /* b\";int c;");
+        success = makeTest<int>(StreamingComparator::firstDifference(streamedFirst, streamedSecond, 3), -1, " normalised streams not recognised as the same");
+        std::stringstream streamedThird(streamedText);
+        std::stringstream streamedFourth("abuk papek;intb=\"a  /* b\";int e;");
+        success = makeTest<int>(StreamingComparator::firstDifference(streamedThird, streamedFourth, 5), 30, " difference in normalised streams found elsewhere");
+        //std::cout << "StreamingNormaliser works." << std::endl;
+
+        // applyEdits and EditBuffer
+        Source testingSource7("int a = 0;\n\tunique_ptr<int> b;\n   unique_ptr<  int> c;\nint d;");
+        EditBuffer editBuffer;
+        testingSource7.iterateThroughOccurrences("unique_ptr<int>", [&](int line, int, bool) -> int {
+            int start = testingSource7.lines[line].find("unique_ptr");
+            editBuffer.replace(line, start, line, testingSource7.lines[line].find('>') + 1, "std::unique_ptr<int>");
+            return line + 1;
+        });
+        editBuffer.insert(0, 0, "// Header\n");
+        EditBuffer::Handle cancelled = editBuffer.erase(3, 0, 3, 4);
+        editBuffer.cancel(cancelled);
+        editBuffer.erase(2, 23, 3, 0);
+        success = makeTest<int>(editBuffer.size(), 4, " edit buffer doesn't hold the edits");
+        editBuffer.applyTo(testingSource7);
+        success = makeTest<std::string>(testingSource7.toString(), "// Header\nint a = 0;\n\tstd::unique_ptr<int> b;\n   std::unique_ptr<int> c;int d;",
+                                        " edits not applied properly");
+        success = makeTest<std::string>(SourceView("ab\ncd").withEdits({SourceEdit(0, 1, 1, 1, "x"), SourceEdit(1, 2, 1, 2, "\n")}).toString(), "axd\n",
+                                        " edits of a view not applied properly");
+        bool overlapFound = false;
+        try {
+            Source("abcd").applyEdits({SourceEdit(0, 0, 0, 2, "x"), SourceEdit(0, 1, 0, 3, "y")});
+        }
+        catch(std::runtime_error &) {
+            overlapFound = true;
+        }
+        success = makeTest<bool>(overlapFound, true, " overlapping edits not detected");
+        //std::cout << "applyEdits() works." << std::endl;
+
+        // EditTransaction
+        Source testingSource7b("unique_ptr<int> a;\nint b; unique_ptr\n  <int> c;\n\"unique_ptr<int>\"\nunique_ptr<int> d; unique_ptr<int> e;");
+        auto qualify = [] (const Source::Occurrence &found) {
+            return std::vector<SourceEdit>{SourceEdit(found.startLine, found.startCharacter, found.startLine, found.startCharacter, "std::")};
+        };
+        EditTransaction transaction;
+        testingSource7b.collectEdits("unique_ptr<int>", transaction, qualify);
+        success = makeTest<int>(transaction.size(), 5, " occurrences not collected as edits");
+        EditTransaction parallelTransaction;
+        parallelTransaction.collectParallel(testingSource7b.lines.size(), 3, [&] (int firstLine, int endLine) {
+            testingSource7b.collectEdits("unique_ptr<int>", parallelTransaction, qualify, firstLine, endLine);
+        });
+        Source parallelEdited = testingSource7b;
+        parallelTransaction.commit(parallelEdited);
+        transaction.commit(testingSource7b);
+        success = makeTest<std::string>(testingSource7b.toString(), "std::unique_ptr<int> a;\nint b; std::unique_ptr\n  <int> c;\n\"std::unique_ptr<int>\"\n"
+                                        "std::unique_ptr<int> d; std::unique_ptr<int> e;", " collected edits not applied properly");
+        success = makeTest<std::string>(parallelEdited.toString(), testingSource7b.toString(), " edits collected in parallel differ");
+        EditTransaction conflictingTransaction;
+        testingSource7b.collectEdits(PatternSet({"std::unique_ptr<int>", "unique_ptr"}), conflictingTransaction, [] (const Source::Occurrence &found) {
+            return std::vector<SourceEdit>{SourceEdit(found.startLine, found.startCharacter, found.endLine, found.endCharacter, "ptr")};
+        });
+        success = makeTest<int>(conflictingTransaction.conflicts().size(), 5, " conflicting edits not found");
+        overlapFound = false;
+        try {
+            conflictingTransaction.commit(testingSource7b);
+        }
+        catch(std::runtime_error &) {
+            overlapFound = true;
+        }
+        success = makeTest<bool>(overlapFound && conflictingTransaction.size() == 10, true, " conflicting transaction committed");
+        success = makeTest<std::string>(testingSource7b.lines[0], "std::unique_ptr<int> a;", " source changed by a failed commit");
+        //std::cout << "EditTransaction works." << std::endl;
+        
+        // TokenIndex
+        Source testingSource8("int a = f(b, /* ( */ c);\n\"str(\" unique_ptr <int> x; // unique_ptr<int>\n/* a\nunique_ptr<int> */ unique_ptr<\n  int> y{'}'};");
+        TokenIndex testingTokens(testingSource8);
+        success = makeTest<int>(testingTokens.tokens.size(), 30, " wrong number of tokens");
+        success = makeTest<int>(testingTokens.findIdentifier(testingSource8, "a").size(), 1, " identifier in a comment found by the index");
+        std::vector<TokenIndex::Match> tokenMatches = testingTokens.find(testingSource8, "unique_ptr<int>");
+        success = makeTest<int>(tokenMatches.size(), 2, " wrong number of token sequences found");
+        success = makeTest<int>(testingTokens.tokens[tokenMatches[1].last].line, 4, " token sequence over two lines not found");
+        Source testingSource8b("x = \"a\\\n\\\n\";");
+        success = makeTest<int>(TokenIndex(testingSource8b).find(testingSource8b, "\\").size(), 0, " part of a literal continued on the next line matched as code");
+        Source testingSource8r("x = R\"(\n&\n)\" & y;");
+        success = makeTest<int>(TokenIndex(testingSource8r).find(testingSource8r, "&").size(), 1, " line of a raw string matched as code");
+        int openingBracket = testingTokens.lineStarts[0] + 4;
+        int closingBracket = testingTokens.findClosing(testingSource8, openingBracket, '(', ')');
+        success = makeTest<int>(testingTokens.tokens[closingBracket].column, 22, " closing bracket on tokens not found");
+        success = makeTest<int>(testingTokens.findClosing(testingSource8, testingTokens.find(testingSource8, "y{")[0].last, '{', '}') > 0, true,
+                                " char literal not skipped when finding a closing bracket");
+        testingSource8.lines[2] = "/* a */ unique_ptr<int> z;";
+        testingTokens.update(testingSource8, 2, 1, 1);
+        success = makeTest<int>(testingTokens.find(testingSource8, "unique_ptr<int>").size(), 4, " token index not updated after the end of a comment");
+        testingSource8.lines.erase(testingSource8.lines.begin() + 2);
+        testingTokens.update(testingSource8, 2, 1, 0);
+        TokenIndex rebuiltTokens(testingSource8);
+        success = makeTest<int>(testingTokens.tokens.size(), rebuiltTokens.tokens.size(), " updated token index differs from a new one");
+        success = makeTest<int>(testingTokens.findIdentifier(testingSource8, "y").size(), 1, " identifier index not rebuilt after an update");
+        TokenIndex searchedTokens(testingSource8);
+        std::vector<int> foundInThreads(4);
+        std::vector<std::thread> searchers;
+        for(int i = 0; i < (int)foundInThreads.size(); i++)
+            searchers.emplace_back([&, i] { foundInThreads[i] = searchedTokens.findIdentifier(testingSource8, "unique_ptr").size(); });
+        for(auto &searcher : searchers)
+            searcher.join();
+        success = makeTest<int>(std::count(foundInThreads.begin(), foundInThreads.end(), 3), 4, " identifiers searched from many threads at once not found");
+        TokenIndex copiedTokens(testingTokens);
+        success = makeTest<int>(copiedTokens.findIdentifier(testingSource8, "y").size(), 1, " identifier not found in a copied token index");
+        success = makeTest<int>(testingTokens.tokens.back().line, 3, " token lines not shifted after an update");
+        //std::cout << "TokenIndex works." << std::endl;
+        
+        // BracketTable
+        TokenIndex testingTokens6(testingSource6);
+        BracketTable testingBrackets6(testingTokens6);
+        for(int depth = 0; depth < 2; depth++) {
+            for(int startCharacter : {1, 2, 10}) {
+                // Starting at depth zero in the middle of a list doesn't make sense
+                if(depth == 0 && startCharacter == 10) continue;
+                int expectedLine = 1;
+                int expectedCharacter = startCharacter;
+                testingSource6.findEndOfList(expectedLine, expectedCharacter, '{', '}', depth);
+                line = 1;
+                character = startCharacter;
+                testingBrackets6.findEndOfList(line, character, '{', '}', depth);
+                success = makeTest<int>(line * 100 + character, expectedLine * 100 + expectedCharacter, " bracket table doesn't find the same end of list");
+            }
+        }
+        success = makeTest<std::string>(testingBrackets6.getTillEndOfList(testingSource6, 1, 1, '{', '}', 1), testingSource6.getTillEndOfList(1, 1, '{', '}', 1),
+                                        " getting till end of list through the bracket table failed");
+        Source testingSource9("if(a < b && c > d) {\n  std::map<int, std::vector<int>> m; f(\")\", /* ) */ x->y);\n  std::cout << (a[1] >= 2);\n}");
+        TokenIndex testingTokens9(testingSource9);
+        BracketTable testingBrackets9(testingTokens9);
+        line = 1;
+        character = 10;
+        testingBrackets9.findEndOfList(line, character, '<', '>');
+        success = makeTest<int>(line * 100 + character, 132, " template brackets not paired");
+        line = 1;
+        character = 38;
+        testingBrackets9.findEndOfList(line, character, '(', ')');
+        success = makeTest<int>(line * 100 + character, 156, " brackets in literals or comments not skipped");
+        line = 2;
+        character = 20;
+        testingBrackets9.findEndOfList(line, character, '{', '}', 1);
+        success = makeTest<int>(line * 100 + character, 300, " enclosing scope not found");
+        success = makeTest<int>(testingBrackets9.partner(testingBrackets9.tokenAt(0, 5)), -2, " comparison paired as a bracket");
+        success = makeTest<int>(testingBrackets9.partner(testingBrackets9.tokenAt(2, 12)), -2, " operator << paired as a bracket");
+        testingSource9.lines[1] = "  f(g(1), (2));";
+        testingTokens9.update(testingSource9, 1, 1, 1);
+        testingBrackets9.invalidate(1);
+        line = 1;
+        character = 3;
+        testingBrackets9.findEndOfList(line, character, '(', ')');
+        success = makeTest<int>(line * 100 + character, 113, " bracket table not updated after a change");
+        //std::cout << "BracketTable works." << std::endl;
+
+        // StructuralPattern
+        Source testingSource13("auto a = std::make_shared<std::map<int, std::vector<int>>>(f(1, 2), \"x\");\n"
+                               "auto b = std::make_shared<Foo>(\n    /* size */ 3);\nstd::make_shared<Bar>(); log(\"a\" \"b\", level);");
+        StructuralPattern makeShared("std::make_shared<$T:list>($ARGS:list)");
+        std::vector<StructuralPattern::Match> structuralMatches = makeShared.find(testingSource13);
+        success = makeTest<int>(structuralMatches.size(), 3, " wrong number of structural matches");
+        int typeHole = makeShared.hole("T");
+        int argumentsHole = makeShared.hole("ARGS");
+        success = makeTest<std::string>(StructuralPattern::text(testingSource13, structuralMatches[0].captures[typeHole]), "std::map<int, std::vector<int>>",
+                                        " type with nested template brackets not captured");
+        success = makeTest<std::string>(StructuralPattern::text(testingSource13, structuralMatches[0].captures[argumentsHole]), "f(1, 2), \"x\"",
+                                        " arguments with nested brackets not captured");
+        success = makeTest<std::string>(StructuralPattern::text(testingSource13, structuralMatches[1].captures[argumentsHole]), "3",
+                                        " arguments after a comment on another line not captured");
+        success = makeTest<int>(structuralMatches[1].whole.endLine, 2, " structural match over lines doesn't end on the right line");
+        success = makeTest<std::string>(StructuralPattern::text(testingSource13, structuralMatches[2].captures[argumentsHole]), "",
+                                        " empty arguments not captured");
+        std::vector<SourceEdit> structuralEdits;
+        for(auto &match : structuralMatches) {
+            std::string type = StructuralPattern::text(testingSource13, match.captures[typeHole]);
+            std::string arguments = StructuralPattern::text(testingSource13, match.captures[argumentsHole]);
+            structuralEdits.push_back(SourceEdit(match.whole.line, match.whole.character, match.whole.endLine, match.whole.endCharacter,
+                                                 "std::shared_ptr<" + type + ">(new " + type + "(" + arguments + "))"));
+        }
+        success = makeTest<std::string>(testingSource13.withEdits(structuralEdits).lines[2], "std::shared_ptr<Bar>(new Bar()); log(\"a\" \"b\", level);",
+                                        " rewrite by a structural pattern not applied properly");
+        StructuralPattern logCall("log($MESSAGE:string, $LEVEL)");
+        structuralMatches = logCall.find(testingSource13);
+        success = makeTest<int>(structuralMatches.size(), 1, " structural pattern with a string not found");
+        success = makeTest<std::string>(StructuralPattern::text(testingSource13, structuralMatches[0].captures[logCall.hole("MESSAGE")]), "\"a\" \"b\"",
+                                        " string literals next to each other not captured");
+        success = makeTest<std::string>(StructuralPattern::text(testingSource13, structuralMatches[0].captures[logCall.hole("LEVEL")]), "level",
+                                        " identifier not captured");
+        success = makeTest<int>(StructuralPattern("f($A:list)").find(Source("f(a; b)")).size(), 0, " list captured over the end of a statement");
+        bool patternRejected = false;
+        try {
+            StructuralPattern("f($A:list $B)");
+        }
+        catch(std::runtime_error &) {
+            patternRejected = true;
+        }
+        success = makeTest<bool>(patternRejected, true, " list followed by a hole accepted");
+        //std::cout << "StructuralPattern works." << std::endl;
+        
+        // SourceView
+        SourceView testingView1("int a = 0;\n\tunique_ptr<int> b;\n   unique_ptr<  int> c;");
+        count = 0;
+        testingView1.iterateThroughOccurrences("unique_ptr<int>", [&](int line, int, bool) -> int {
+            count += line;
+            return line + 1;
+        });
+        success = makeTest<int>(count, 3, " iterating through occurrences in a view failed");
+        success = makeTest<int>(testingView1.findNextLineContaining("unique", 0), 1, " finding next line in a view failed");
+        success = makeTest<std::string>(testingView1.whatIsItAssignedTo(0, 8), "a", " checking what is assigned in a view failed");
+        SourceView testingView2("\n{32, 64, { 27, 18 },\n{ 3, 15, { 2 }}}");
+        success = makeTest<std::string>(testingView2.getTillEndOfList(1, 1, '{', '}', 1), "32, 64, { 27, 18 },{ 3, 15, { 2 }}",
+                                        " getting till end of list in a view failed");
+        success = makeTest<int>(testingView2.parseList(1, 1, ',', '}', '{').size(), 4, " list parsing in a view failed");
+        std::string viewFileName = (testDirectory / "view_test.txt").string();
+        testingSource6.toFile(viewFileName, false, false);
+        SourceView mappedView = SourceView::fromFile(viewFileName);
+        std::remove(viewFileName.c_str());
+        success = makeTest<std::string>(mappedView.toString(), testingSource6.toString(), " mapped file not read properly");
+        Source copiedFromView(mappedView);
+        copiedFromView.lines[1] += "// edited";
+        success = makeTest<std::string>(std::string(mappedView.lines[1]), "{32, 64, { 27, 18 },", " editing a copy changed the view");
+        SourceView editedView = mappedView;
+        editedView.applyEdits({SourceEdit(1, 1, 1, 3, "16"), SourceEdit(2, 0, 2, 0, "\n")});
+        success = makeTest<std::string>(editedView.toString(), "\n{16, 64, { 27, 18 },\n\n{ 3, 15, { 2 }}}", " editing a view failed");
+        success = makeTest<bool>(editedView.lines[0].data() == mappedView.lines[0].data(), true, " untouched line of an edited view copied");
+        success = makeTest<std::string>(std::string(mappedView.lines[1]), "{32, 64, { 27, 18 },", " editing a view changed its copy");
+        EditBuffer viewEdits;
+        viewEdits.insert(3, 0, "x");
+        viewEdits.applyTo(editedView);
+        editedView.compact();
+        success = makeTest<std::string>(editedView.toString(), "\n{16, 64, { 27, 18 },\n\nx{ 3, 15, { 2 }}}", " compacting an edited view failed");
+        success = makeTest<bool>(editedView.lines[2].data() == editedView.lines[1].data() + editedView.lines[1].size() + 1, true,
+                                 " compacted view not contiguous");
+        //std::cout << "SourceView works." << std::endl;
+        
+        // SourceSnapshot
+        Source testingSource14("int a = 0;\nint b = make(1);\nint c = make(2);\nint d = 0;\nint e;");
+        Source assigned;
+        success = makeTest<bool>(&(assigned = testingSource14) == &assigned, true, " assignment doesn't return the source assigned to");
+        Source movedInto;
+        movedInto = std::move(assigned);
+        success = makeTest<std::string>(movedInto.lines[3], "int d = 0;", " move assignment lost the lines");
+        SourceSnapshot original(std::move(movedInto));
+        SourceSnapshot candidate = original;
+        candidate.applyEdits({SourceEdit(1, 8, 1, 15, "build(1)"), SourceEdit(2, 8, 2, 12, "build"), SourceEdit(2, 16, 3, 0, "\n\n")});
+        success = makeTest<std::string>(candidate.view().toString(), "int a = 0;\nint b = build(1);\nint c = build(2);\n\nint d = 0;\nint e;",
+                                        " edits of a snapshot not applied properly");
+        success = makeTest<std::string>(original.toSource().toString(), testingSource14.toString(), " editing a fork changed the snapshot");
+        success = makeTest<bool>(&candidate[0] == &original[0] && &candidate[5] == &original[4], true, " untouched lines of a fork copied");
+        SourceSnapshot secondCandidate = candidate;
+        secondCandidate.applyEdits({SourceEdit(4, 4, 4, 5, "e")});
+        success = makeTest<bool>(&secondCandidate[1] == &candidate[1], true, " lines edited by an earlier fork not shared");
+        success = makeTest<int>(SourceView::mismatches(candidate.view(), SourceView("int a = 0;\nint b = build(1);\nint c = build(2);\nint d = 0;\nint e;"), 20, false), 0,
+                                " snapshot compared with mismatches wrongly");
+        bool snapshotEditRejected = false;
+        try {
+            candidate.applyEdits({SourceEdit(0, 0, 0, 1, ""), SourceEdit(9, 0, 9, 0, "x")});
+        }
+        catch(std::runtime_error &) {
+            snapshotEditRejected = true;
+        }
+        success = makeTest<bool>(snapshotEditRejected && candidate.size() == 6 && candidate[0] == "int a = 0;", true,
+                                 " wrong edit of a snapshot not rejected or left it changed");
+        //std::cout << "SourceSnapshot works." << std::endl;
+        
+        // toFile
+        std::string writtenFileName = (testDirectory / "write_test.txt").string();
+        Source writtenSource("int a;\nb = c;\n");
+        success = makeTest<bool>(writtenSource.toFile(writtenFileName, false, false), true, " new file not written");
+        auto writtenTime = std::filesystem::last_write_time(writtenFileName);
+        std::filesystem::last_write_time(writtenFileName, writtenTime - std::chrono::hours(1));
+        success = makeTest<bool>(writtenSource.toFile(writtenFileName, false, false), false, " file with the same contents written again");
+        success = makeTest<bool>(std::filesystem::last_write_time(writtenFileName) == writtenTime - std::chrono::hours(1), true,
+                                 " unchanged file touched");
+        success = makeTest<bool>(writtenSource.toFile(writtenFileName, true, false), true, " file with other contents not written");
+        success = makeTest<std::string>(SourceView::fromFile(writtenFileName).toString(), "int a;b = c;", " lines not joined when writing on one line");
+        std::stringstream reported;
+        std::streambuf *coutBuffer = std::cout.rdbuf(reported.rdbuf());
+        writtenSource.toFile(writtenFileName, true);
+        std::cout.rdbuf(coutBuffer);
+        success = makeTest<std::string>(reported.str(), "Already saved as " + writtenFileName + "\n", " writing not reported by default");
+        writeFile(writtenFileName, "int a;\nb = c;\n");
+        success = makeTest<bool>(Source::fromFile(writtenFileName).toFile(writtenFileName, false, false), false, " loaded file ending with a line break written again");
+        success = makeTest<bool>(fileContains(writtenFileName, "int a;\nb = c;\n"), true, " line break ending a loaded file removed when saving it");
+        std::remove(writtenFileName.c_str());
+        success = makeTest<int>(writtenSource.outputSize(true) * 100 + writtenSource.outputSize(), 1213, " output size not computed properly");
+        //std::cout << "toFile works." << std::endl;
+        
+        // BatchEditor
+        success = makeTest(BatchEditor::matchesPattern("source.cpp", "*.cpp"), true, " wildcard pattern not matched");
+        success = makeTest(BatchEditor::matchesPattern("source.cpp.bak", "*.cpp"), false, " wildcard pattern matched where it shouldn't");
+        success = makeTest(BatchEditor::matchesPattern("a.h", "?.h"), true, " single character wildcard not matched");
+        std::string batchDirectory = (testDirectory / "batch_test").string();
+        std::filesystem::create_directories(batchDirectory + "/nested");
+        Source("int a = 0;").toFile(batchDirectory + "/first.cpp", false, false);
+        Source("float b = 0;").toFile(batchDirectory + "/nested/second.cpp", false, false);
+        Source("int c = 0;").toFile(batchDirectory + "/third.h", false, false);
+        BatchEditor batchEditor(2);
+        std::vector<BatchEditor::FileResult> batchResults = batchEditor.run(batchDirectory, "*.cpp", [] (Source &source) {
+            bool changed = false;
+            source.iterateThroughOccurrences("int ", [&](int line, int character, bool) -> int {
+                source.lines[line].replace(character - 4, 3, "long");
+                changed = true;
+                return line + 1;
+            });
+            return changed;
+        });
+        success = makeTest<int>(batchResults.size(), 2, " batch editing didn't find the right files");
+        success = makeTest<bool>(batchResults[0].changed, true, " batch editing didn't report a change");
+        success = makeTest<bool>(batchResults[1].changed, false, " batch editing reported a change that didn't happen");
+        success = makeTest<std::string>(Source::fromFile(batchDirectory + "/first.cpp").toString(), "long a = 0;", " batch editing didn't save the edit");
+        success = makeTest<std::string>(Source::fromFile(batchDirectory + "/third.h").toString(), "int c = 0;", " batch editing edited a wrong file");
+        std::string cacheFile = batchDirectory + "/cache";
+        std::atomic<int> transformed{0};
+        BatchEditor::Transform countedTransform = [&] (Source &source) {
+            transformed++;
+            if(source.lines.empty() || source.lines[0].compare(0, 4, "long") != 0) return false;
+            source.lines[0].replace(0, 4, "int64_t");
+            return true;
+        };
+        {
+            RunCache cache(cacheFile);
+            batchEditor.run(batchDirectory, "*.cpp", countedTransform, cache, "long to int64_t");
+        }
+        success = makeTest<int>(transformed.load(), 2, " files transformed when the cache is empty");
+        Source("long d = 0;").toFile(batchDirectory + "/first.cpp", false, false);
+        {
+            RunCache cache(cacheFile);
+            success = makeTest<int>(cache.size(), 2, " cache not saved or loaded");
+            batchResults = batchEditor.run(batchDirectory, "*.cpp", countedTransform, cache, "long to int64_t");
+        }
+        success = makeTest<int>(transformed.load(), 3, " a file with changed contents not transformed or unchanged files transformed again");
+        success = makeTest<bool>(batchResults[0].cached || !batchResults[0].changed || !batchResults[1].cached, false, " cached files reported wrongly");
+        success = makeTest<std::string>(Source::fromFile(batchDirectory + "/first.cpp").toString(), "int64_t d = 0;", " file with changed contents not edited");
+        Source("long a = 0;").toFile(batchDirectory + "/first.cpp", false, false);
+        {
+            RunCache cache(cacheFile);
+            batchEditor.run(batchDirectory, "*.cpp", countedTransform, cache, "long to int64_t");
+            batchEditor.run(batchDirectory, "*.cpp", countedTransform, cache, "something else");
+        }
+        success = makeTest<int>(transformed.load(), 5, " cache doesn't tell transforms apart");
+        success = makeTest<std::string>(Source::fromFile(batchDirectory + "/first.cpp").toString(), "int64_t a = 0;", " cached output not written");
+        for(uint64_t damagedLength : {~uint64_t(0), uint64_t(1) << 40}) {
+            // The name of the transform of the first entry claims to be longer than the file
+            std::string damaged = "EUCACHE1" + std::string(24, '\0') + "x";
+            std::memcpy(&damaged[24], &damagedLength, sizeof(damagedLength));
+            writeFile(cacheFile, damaged);
+            bool emptyLoaded = false;
+            try {
+                RunCache cache(cacheFile);
+                emptyLoaded = cache.size() == 0;
+            }
+            catch(std::exception &) {}
+            success = makeTest<bool>(emptyLoaded, true, " cache with a damaged length not loaded as empty");
+        }
+        batchResults = batchEditor.runPipelined(batchDirectory, "*.cpp", [] (Source &source) {
+            if(source.lines[0].compare(0, 5, "float") == 0) source.lines[0].replace(0, 5, "double");
+            return true;
+        }, 1);
+        success = makeTest<std::string>(std::to_string(batchResults[0].changed) + std::to_string(batchResults[1].changed), "01",
+                                        " pipelined editing didn't tell which files really changed");
+        success = makeTest<std::string>(Source::fromFile(batchDirectory + "/nested/second.cpp").toString(), "double b = 0;", " pipelined editing didn't save the edit");
+        batchResults = batchEditor.runPipelined(std::vector<std::string>{batchDirectory + "/missing.cpp", batchDirectory + "/first.cpp"},
+                                                [] (Source &) -> bool { throw(std::runtime_error("failed")); });
+        success = makeTest<bool>(batchResults[0].error.empty() || batchResults[1].error != "failed", false, " pipelined editing didn't report errors");
+        std::string untouchedFile = batchDirectory + "/untouched.cpp";
+        writeFile(untouchedFile, "int a;\nint b;\n");
+        batchResults = batchEditor.runPipelined(std::vector<std::string>{untouchedFile}, [] (Source &) { return true; });
+        success = makeTest<bool>(batchResults[0].changed, false, " pipelined editing reported a file the transform didn't edit as changed");
+        success = makeTest<bool>(fileContains(untouchedFile, "int a;\nint b;\n"), true, " pipelined editing rewrote a file the transform didn't edit");
+        batchEditor.run(std::vector<std::string>{untouchedFile}, [] (Source &) { return true; });
+        success = makeTest<bool>(fileContains(untouchedFile, "int a;\nint b;\n"), true, " batch editing rewrote a file the transform didn't edit");
+        std::string restrictedFile = batchDirectory + "/restricted.cpp";
+        Source("int e = 0;").toFile(restrictedFile, false, false);
+        std::filesystem::perms restricted = std::filesystem::perms::owner_all | std::filesystem::perms::group_read;
+        std::filesystem::permissions(restrictedFile, restricted);
+        batchResults = batchEditor.run(std::vector<std::string>{restrictedFile, restrictedFile}, [] (Source &source) {
+            if(source.lines[0].compare(0, 3, "int") == 0) source.lines[0].replace(0, 3, "long");
+            return true;
+        });
+        success = makeTest<std::string>(batchResults[0].error + batchResults[1].error, "", " the same file edited twice at once failed");
+        success = makeTest<std::string>(Source::fromFile(restrictedFile).toString(), "long e = 0;", " the same file edited twice at once not saved");
+        success = makeTest<bool>((std::filesystem::status(restrictedFile).permissions() & std::filesystem::perms::all) == restricted, true,
+                                 " permissions of an edited file not kept");
+        int temporaryFiles = 0;
+        for(const auto &entry : std::filesystem::recursive_directory_iterator(batchDirectory))
+            temporaryFiles += entry.path().filename().string().find(".editing_tmp") != std::string::npos;
+        success = makeTest<int>(temporaryFiles, 0, " temporary files left behind");
+        std::filesystem::remove_all(batchDirectory);
+        batchResults = batchEditor.run(std::vector<std::string>{batchDirectory + "/missing.cpp"}, [] (Source &) { return false; });
+        success = makeTest<bool>(batchResults[0].error.empty(), false, " batch editing didn't report a missing file");
+        //std::cout << "BatchEditor works." << std::endl;
+        
+        // SymbolIndex
+        std::string symbolDirectory = (testDirectory / "symbol_test").string();
+        std::filesystem::create_directories(symbolDirectory);
+        std::string symbolFile = symbolDirectory + "/index";
+        Source("int counter = 0;\nvoid increase(int step)\n{\n    counter += step;\n    std::vector<int> values;\n    if(counter == 3) record(counter);\n}")
+            .toFile(symbolDirectory + "/a.cpp", false, false);
+        Source("extern int counter;\nint read() { return counter; }").toFile(symbolDirectory + "/b.cpp", false, false);
+        auto describe = [] (const std::vector<SymbolIndex::Occurrence> &occurrences) {
+            std::string retval;
+            for(auto &occurrence : occurrences)
+                retval += std::string(occurrence.file.substr(occurrence.file.size() - 5)) + ":" + std::to_string(occurrence.line) + ":"
+                          + std::to_string(occurrence.column) + "DAU"[occurrence.role] + " ";
+            return retval;
+        };
+        {
+            SymbolIndex symbols(symbolFile);
+            success = makeTest<int>(symbols.update(symbolDirectory, "*.cpp", 2), 2, " not all files lexed when building the symbol index");
+            success = makeTest<std::string>(describe(symbols.find("counter")), "a.cpp:0:4D a.cpp:3:4A a.cpp:5:7U a.cpp:5:28U b.cpp:0:11D b.cpp:1:20U ",
+                                            " occurrences of a symbol found wrongly");
+            success = makeTest<std::string>(describe(symbols.find("values")) + describe(symbols.find("step", SymbolIndex::Declaration)),
+                                            "a.cpp:4:21D a.cpp:1:18D ", " declarations after a template or in parameters not found");
+            success = makeTest<int>(symbols.find("return").size() + symbols.find("missing").size(), 0, " keyword or missing symbol found");
+        }
+        auto indexTime = std::filesystem::last_write_time(symbolFile) - std::chrono::hours(1);
+        std::filesystem::last_write_time(symbolFile, indexTime);
+        Source("int counter2;\nint read() { counter = 1; return counter; }").toFile(symbolDirectory + "/b.cpp", false, false);
+        {
+            SymbolIndex symbols(symbolFile);
+            success = makeTest<int>(symbols.fileCount(), 2, " symbol index not loaded");
+            success = makeTest<int>(symbols.update(symbolDirectory, "*.cpp", 2), 1, " unchanged file lexed again or changed file not");
+            success = makeTest<std::string>(describe(symbols.find("counter")), "a.cpp:0:4D a.cpp:3:4A a.cpp:5:7U a.cpp:5:28U b.cpp:1:13A b.cpp:1:33U ",
+                                            " symbol index not updated properly");
+            success = makeTest<std::string>(describe(symbols.find("counter2")), "b.cpp:0:4D ", " symbol of a changed file not added");
+            indexTime = std::filesystem::last_write_time(symbolFile);
+            std::filesystem::last_write_time(symbolFile, indexTime - std::chrono::hours(1));
+            success = makeTest<int>(symbols.update(symbolDirectory, "*.cpp", 2), 0, " files lexed when nothing changed");
+            success = makeTest<bool>(std::filesystem::last_write_time(symbolFile) == indexTime - std::chrono::hours(1), true,
+                                     " symbol index written when nothing changed");
+        }
+        Source("damaged").toFile(symbolFile, false, false);
+        success = makeTest<int>(SymbolIndex(symbolFile).fileCount(), 0, " damaged symbol index not treated as empty");
+        std::filesystem::remove_all(symbolDirectory);
+        //std::cout << "SymbolIndex works." << std::endl;
         
     }
     catch(std::exception &exception) {
         std::cout << "A test threw an exception: " << exception.what() << std::endl;
         success = false;
     }
+    std::error_code ignored;
+    if(!testDirectory.empty()) std::filesystem::remove_all(testDirectory, ignored);
     
     return success.passed();
 }